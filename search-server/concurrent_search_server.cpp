@@ -0,0 +1,79 @@
+#include "concurrent_search_server.h"
+
+ConcurrentSearchServer::ConcurrentSearchServer()
+    : copies_(make_shared<Copies>()) {
+}
+
+shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+    int published = 0;
+    {
+        lock_guard guard(copies_->readers_mutex);
+        published = copies_->published;
+        ++copies_->reader_counts[published];
+    }
+    // The deleter only releases the copy; the last release of a retired copy wakes the writer
+    return shared_ptr<const SearchServer>(copies_->servers[published].get(), [copies = copies_, published](const SearchServer*) {
+        lock_guard guard(copies->readers_mutex);
+        if (--copies->reader_counts[published] == 0 && published != copies->published) {
+            copies->readers_released.notify_all();
+        }
+    });
+}
+
+tuple<vector<string>, DocumentStatus> ConcurrentSearchServer::MatchDocument(const string_view& raw_query, int document_id) const {
+    const auto snapshot = GetSnapshot();
+    const auto [words, status] = snapshot->MatchDocument(raw_query, document_id);
+    return { vector<string>(words.begin(), words.end()), status };
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, const string_view& document, DocumentStatus status, const vector<int>& ratings) {
+    Write([document_id, text = string(document), status, ratings](SearchServer& search_server) {
+        search_server.AddDocument(document_id, text, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Write([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+size_t ConcurrentSearchServer::CompactRemovedDocuments(size_t max_document_count) {
+    // The update is kept for the replay on the other copy, so the result must not live on this stack
+    auto document_count = make_shared<size_t>(0);
+    Write([max_document_count, document_count](SearchServer& search_server) {
+        *document_count = search_server.CompactRemovedDocuments(max_document_count);
+    });
+    return *document_count;
+}
+
+void ConcurrentSearchServer::Write(Update update) {
+    lock_guard guard(write_mutex_);
+
+    // Readers that picked up the retired copy before it was replaced may still be using it;
+    // the mutex also makes whatever they did happen before the replay below
+    int retired = 0;
+    {
+        unique_lock lock(copies_->readers_mutex);
+        retired = 1 - copies_->published;
+        copies_->readers_released.wait(lock, [this, retired]() {
+            return copies_->reader_counts[retired] == 0;
+        });
+    }
+    SearchServer& search_server = *copies_->servers[retired];
+
+    for (const Update& pending : pending_updates_) {
+        pending(search_server);
+    }
+    pending_updates_.clear();
+
+    update(search_server);
+    pending_updates_.push_back(move(update));
+
+    lock_guard readers_guard(copies_->readers_mutex);
+    copies_->published = retired;
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "search_server.h"
+
+using namespace std;
+
+// SearchServer that can be queried while documents are being added or removed.
+// It keeps two copies of the index (left-right). Readers work on the published copy,
+// which is never modified while anyone holds it; every copy counts its readers. A writer
+// changes the other copy, publishes it, and brings the retired one up to date before its
+// next change, sleeping until the last reader of that copy has let go of it. Queries
+// never wait for writers beyond the moment of publishing; writers are serialized among
+// themselves. The price is holding the index twice.
+//
+// A snapshot held across two writes blocks the second one until it is released, so
+// snapshots are meant for the span of a query. A thread must not write while it holds
+// a snapshot: the write may wait for that very snapshot and never return.
+class ConcurrentSearchServer {
+public:
+    ConcurrentSearchServer();
+
+    template <typename StopWords>
+    explicit ConcurrentSearchServer(const StopWords& stop_words);
+
+    // The published version; it stays unchanged for as long as the pointer is held,
+    // which may outlive this object
+    shared_ptr<const SearchServer> GetSnapshot() const;
+
+    template <typename... Args>
+    vector<Document> FindTopDocuments(const Args&... args) const;
+
+    // Words are copied, so they outlive the version they were found in
+    tuple<vector<string>, DocumentStatus> MatchDocument(const string_view& raw_query, int document_id) const;
+
+    int GetDocumentCount() const;
+
+    void AddDocument(int document_id, const string_view& document, DocumentStatus status, const vector<int>& ratings);
+
+    // The whole batch becomes visible to readers at once
+    template <typename ExecutionPolicy, typename DocumentRange>
+    void AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents);
+
+    void RemoveDocument(int document_id);
+
+    size_t CompactRemovedDocuments(size_t max_document_count = numeric_limits<size_t>::max());
+
+private:
+    using Update = function<void(SearchServer&)>;
+
+    // The two copies and their readers; shared with the snapshots, so that a snapshot
+    // released after this object is gone still has its copy and counter
+    struct Copies {
+        template <typename... Args>
+        explicit Copies(const Args&... args);
+
+        unique_ptr<SearchServer> servers[2];
+
+        // Guards published and reader_counts, and nothing else, so readers never
+        // wait for a write to finish
+        mutex readers_mutex;
+        condition_variable readers_released;
+        int published = 0;
+        int reader_counts[2] = { 0, 0 };
+    };
+
+    mutex write_mutex_;
+
+    shared_ptr<Copies> copies_;
+
+    // Updates the retired copy lags behind by
+    vector<Update> pending_updates_;
+
+    // Applies the update to the retired copy and publishes it. If the update throws,
+    // nothing is published and the copies stay in step
+    void Write(Update update);
+};
+
+template <typename... Args>
+ConcurrentSearchServer::Copies::Copies(const Args&... args)
+    : servers{ make_unique<SearchServer>(args...), make_unique<SearchServer>(args...) } {
+}
+
+template <typename StopWords>
+ConcurrentSearchServer::ConcurrentSearchServer(const StopWords& stop_words)
+    : copies_(make_shared<Copies>(stop_words)) {
+}
+
+template <typename... Args>
+vector<Document> ConcurrentSearchServer::FindTopDocuments(const Args&... args) const {
+    return GetSnapshot()->FindTopDocuments(args...);
+}
+
+template <typename ExecutionPolicy, typename DocumentRange>
+void ConcurrentSearchServer::AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents) {
+    // The batch is replayed on the other copy later, so it keeps its own texts
+    auto batch = make_shared<vector<tuple<int, string, DocumentStatus, vector<int>>>>();
+    for (const auto& [document_id, document, status, ratings] : documents) {
+        batch->emplace_back(document_id, string(document), status, ratings);
+    }
+    Write([policy, batch](SearchServer& search_server) {
+        search_server.AddDocuments(policy, *batch);
+    });
+}
\ No newline at end of file
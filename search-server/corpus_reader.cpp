@@ -0,0 +1,149 @@
+#include "corpus_reader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(string_view text, DocumentStatus& status) {
+    if (text == "ACTUAL"sv) {
+        status = DocumentStatus::ACTUAL;
+    }
+    else if (text == "IRRELEVANT"sv) {
+        status = DocumentStatus::IRRELEVANT;
+    }
+    else if (text == "BANNED"sv) {
+        status = DocumentStatus::BANNED;
+    }
+    else if (text == "REMOVED"sv) {
+        status = DocumentStatus::REMOVED;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+// Cuts the text up to the next tab off the line
+bool TakeField(string_view& line, string_view& field) {
+    const size_t tab = line.find('\t');
+    if (tab == line.npos) {
+        return false;
+    }
+    field = line.substr(0, tab);
+    line.remove_prefix(tab + 1);
+    return true;
+}
+
+}
+
+CorpusReader::CorpusReader(const string& path) {
+    if (path == "-"s) {
+        input_ = &cin;
+        buffer_.resize(CORPUS_BUFFER_SIZE);
+        return;
+    }
+    // A file is mapped as a whole, so no refills are needed
+    file_ = make_unique<MappedFile>(path);
+    data_ = file_->GetData();
+    is_input_end_ = true;
+}
+
+CorpusReader::CorpusReader(istream& input, size_t buffer_size)
+    : input_(&input)
+    , buffer_(max<size_t>(buffer_size, 1)) {
+}
+
+IteratorRange<vector<CorpusDocument>::const_iterator> CorpusReader::ReadBatch(size_t max_count) {
+    if (batch_.size() < max_count) {
+        batch_.resize(max_count);
+    }
+    size_t count = 0;
+    while (count < max_count) {
+        size_t line_end = data_.find('\n', position_);
+        if (line_end == data_.npos) {
+            if (!is_input_end_) {
+                // Documents already read point into the buffer, so it is refilled only between batches
+                if (count > 0) {
+                    break;
+                }
+                Refill();
+                continue;
+            }
+            if (position_ == data_.size()) {
+                break;
+            }
+            line_end = data_.size();
+        }
+        string_view line = data_.substr(position_, line_end - position_);
+        position_ = min(line_end + 1, data_.size());
+        ++line_number_;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        ParseLine(line, batch_[count]);
+        ++count;
+    }
+    return { batch_.cbegin(), batch_.cbegin() + count };
+}
+
+size_t CorpusReader::GetLineNumber() const {
+    return line_number_;
+}
+
+void CorpusReader::Refill() {
+    const size_t tail_size = data_.size() - position_;
+    if (tail_size > 0) {
+        memmove(buffer_.data(), data_.data() + position_, tail_size);
+    }
+    if (tail_size == buffer_.size()) {
+        // A single line does not fit
+        buffer_.resize(buffer_.size() * 2);
+    }
+    input_->read(buffer_.data() + tail_size, buffer_.size() - tail_size);
+    const size_t read_size = input_->gcount();
+    is_input_end_ = read_size < buffer_.size() - tail_size;
+    data_ = string_view(buffer_.data(), tail_size + read_size);
+    position_ = 0;
+}
+
+void CorpusReader::ParseLine(string_view line, CorpusDocument& document) const {
+    string_view id_field;
+    string_view status_field;
+    string_view ratings_field;
+    bool is_valid = TakeField(line, id_field)
+        && TakeField(line, status_field)
+        && TakeField(line, ratings_field)
+        && ParseInt(id_field, document.id)
+        && ParseStatus(status_field, document.status);
+
+    document.ratings.clear();
+    while (is_valid && !ratings_field.empty()) {
+        const size_t separator = ratings_field.find_first_of(" ,"sv);
+        const string_view rating = ratings_field.substr(0, separator);
+        ratings_field.remove_prefix(separator == ratings_field.npos ? ratings_field.size() : separator + 1);
+        if (rating.empty()) {
+            continue;
+        }
+        int value = 0;
+        is_valid = ParseInt(rating, value);
+        if (is_valid) {
+            document.ratings.push_back(value);
+        }
+    }
+    if (!is_valid || document.ratings.empty()) {
+        throw invalid_argument("Corpus line "s + to_string(line_number_) + " is malformed"s);
+    }
+    document.text = line;
+}
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "paginator.h"
+#include "search_server.h"
+
+using namespace std;
+
+const size_t CORPUS_BUFFER_SIZE = 4 << 20;
+
+const size_t CORPUS_BATCH_SIZE = 4096;
+
+// Unpacks the same way AddDocuments expects: [document_id, document, status, ratings]
+struct CorpusDocument {
+    int id = 0;
+    string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    vector<int> ratings;
+};
+
+// Reads a corpus with one document per line:
+//   <id> TAB <status> TAB <ratings> TAB <text>
+// where status is ACTUAL, IRRELEVANT, BANNED or REMOVED and ratings are at least one
+// integer separated by spaces or commas. Empty lines are skipped.
+// Lines are parsed in place, so texts point into the reader's buffer.
+class CorpusReader {
+public:
+    // "-" reads standard input
+    explicit CorpusReader(const string& path);
+
+    explicit CorpusReader(istream& input, size_t buffer_size = CORPUS_BUFFER_SIZE);
+
+    // Up to max_count documents; they stay valid until the next call. Empty at the end of input.
+    // Throws invalid_argument naming the line if a line is malformed
+    IteratorRange<vector<CorpusDocument>::const_iterator> ReadBatch(size_t max_count = CORPUS_BATCH_SIZE);
+
+    size_t GetLineNumber() const;
+
+private:
+    unique_ptr<MappedFile> file_;
+    istream* input_ = nullptr;
+    vector<char> buffer_;
+    string_view data_;
+    size_t position_ = 0;
+    bool is_input_end_ = false;
+    size_t line_number_ = 0;
+    // Elements are reused between batches, so their ratings keep their capacity
+    vector<CorpusDocument> batch_;
+
+    // Moves the unread tail to the front of the buffer and appends what the stream has
+    void Refill();
+
+    void ParseLine(string_view line, CorpusDocument& document) const;
+};
+
+// Feeds everything the reader has into the server batch by batch; returns the number of documents added
+template <typename ExecutionPolicy>
+size_t LoadCorpus(const ExecutionPolicy& policy, SearchServer& search_server, CorpusReader& reader, size_t batch_size = CORPUS_BATCH_SIZE) {
+    size_t document_count = 0;
+    for (auto batch = reader.ReadBatch(batch_size); batch.size() > 0; batch = reader.ReadBatch(batch_size)) {
+        search_server.AddDocuments(policy, batch);
+        document_count += batch.size();
+    }
+    return document_count;
+}
\ No newline at end of file
@@ -16,4 +16,11 @@ struct Document {
     int rating = 0;
 };
 
+enum class DocumentStatus {
+    ACTUAL,
+    IRRELEVANT,
+    BANNED,
+    REMOVED,
+};
+
 ostream& operator<<(ostream& out, const Document& document);
\ No newline at end of file
@@ -0,0 +1,489 @@
+#include "inverted_index.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+bool PostingLess(const Posting& posting, int document_id) {
+    return posting.document_id < document_id;
+}
+
+bool BlockLess(const PostingsBlock& block, int document_id) {
+    return block.last_document_id < document_id;
+}
+
+bool ChunkLess(const PostingsChunk& chunk, int document_id) {
+    return chunk.blocks.back().last_document_id < document_id;
+}
+
+}
+
+GenerationCachedValue::GenerationCachedValue(const GenerationCachedValue& other) noexcept {
+    *this = other;
+}
+
+GenerationCachedValue& GenerationCachedValue::operator=(const GenerationCachedValue& other) noexcept {
+    const uint64_t generation = other.generation_.load(memory_order_acquire);
+    Set(generation, other.value_.load(memory_order_relaxed));
+    return *this;
+}
+
+bool GenerationCachedValue::Get(uint64_t generation, double& value) const {
+    if (generation_.load(memory_order_acquire) != generation) {
+        return false;
+    }
+    value = value_.load(memory_order_relaxed);
+    return true;
+}
+
+void GenerationCachedValue::Set(uint64_t generation, double value) const {
+    // The value is published before the generation that makes it visible
+    value_.store(value, memory_order_relaxed);
+    generation_.store(generation, memory_order_release);
+}
+
+int InvertedIndex::FindTerm(const string_view& word) const {
+    return dictionary_.Find(word);
+}
+
+const string_view& InvertedIndex::GetTerm(int term_id) const {
+    return dictionary_.GetTerm(term_id);
+}
+
+void DecodePostingsBlock(const PostingsChunk& chunk, size_t block, DecodedPostingsBlock& decoded) {
+    if (!chunk.IsCompressed()) {
+        const size_t first = block * POSTINGS_BLOCK_SIZE;
+        decoded.size = min(POSTINGS_BLOCK_SIZE, chunk.postings.size() - first);
+        for (size_t i = 0; i < decoded.size; ++i) {
+            decoded.document_ids[i] = chunk.postings[first + i].document_id;
+            decoded.term_freqs[i] = chunk.postings[first + i].term_freq;
+        }
+        return;
+    }
+    const PostingsBlock& summary = chunk.blocks[block];
+    DecodeDocumentIds(chunk, block, decoded.document_ids.data());
+    decoded.size = summary.size;
+    // Term frequencies follow the id gaps: exact ones two words each, codes two to a word
+    const uint32_t* term_freq_words = chunk.packed.data() + summary.offset + GetPackedWordCount(summary.bit_width, summary.size);
+    if (!chunk.quantized_term_freqs) {
+        memcpy(decoded.term_freqs.data(), term_freq_words, decoded.size * sizeof(double));
+        return;
+    }
+    uint16_t codes[POSTINGS_BLOCK_SIZE + 1];
+    memcpy(codes, term_freq_words, (summary.size + 1) / 2 * sizeof(uint32_t));
+    DequantizeTermFreqs(codes, decoded.size, decoded.term_freqs.data());
+}
+
+void DecodeDocumentIds(const PostingsChunk& chunk, size_t block, int* document_ids) {
+    const PostingsBlock& summary = chunk.blocks[block];
+    uint32_t gaps[POSTINGS_BLOCK_SIZE] = {};
+    UnpackBlock(chunk.packed.data() + summary.offset, summary.size, summary.bit_width, gaps);
+    DecodeGaps(gaps, summary.first_document_id, document_ids);
+}
+
+PostingsCursor::PostingsCursor(const vector<PostingsChunk>& chunks)
+    : chunks_(&chunks) {
+    if (!IsEnd()) {
+        LoadBlock();
+    }
+}
+
+bool PostingsCursor::IsEnd() const {
+    return chunk_ >= chunks_->size();
+}
+
+int PostingsCursor::GetDocumentId() const {
+    return decoded_.document_ids[position_];
+}
+
+double PostingsCursor::GetTermFreq() const {
+    return decoded_.term_freqs[position_];
+}
+
+void PostingsCursor::Next() {
+    if (++position_ < decoded_.size) {
+        return;
+    }
+    position_ = 0;
+    if (++block_ == (*chunks_)[chunk_].blocks.size()) {
+        ++chunk_;
+        block_ = 0;
+    }
+    if (!IsEnd()) {
+        LoadBlock();
+    }
+}
+
+void PostingsCursor::SkipTo(int document_id) {
+    if (IsEnd() || GetDocumentId() >= document_id) {
+        return;
+    }
+    if (decoded_.document_ids[decoded_.size - 1] < document_id) {
+        size_t first_block = block_ + 1;
+        if (ChunkLess((*chunks_)[chunk_], document_id)) {
+            chunk_ = lower_bound(chunks_->begin() + chunk_ + 1, chunks_->end(), document_id, ChunkLess) - chunks_->begin();
+            first_block = 0;
+            if (IsEnd()) {
+                return;
+            }
+        }
+        // The chunk holds a posting with id not less than document_id, so the block is found
+        const auto& blocks = (*chunks_)[chunk_].blocks;
+        block_ = lower_bound(blocks.begin() + first_block, blocks.end(), document_id, BlockLess) - blocks.begin();
+        position_ = 0;
+        LoadBlock();
+    }
+    const int* document_ids = decoded_.document_ids.data();
+    position_ = lower_bound(document_ids + position_, document_ids + decoded_.size, document_id) - document_ids;
+}
+
+double PostingsCursor::GetBlockMaxTermFreq(int document_id) {
+    if (bound_chunk_ < chunk_) {
+        bound_chunk_ = chunk_;
+        bound_block_ = 0;
+    }
+    if (bound_chunk_ == chunk_) {
+        bound_block_ = max(bound_block_, block_);
+    }
+    if (bound_chunk_ < chunks_->size() && ChunkLess((*chunks_)[bound_chunk_], document_id)) {
+        bound_chunk_ = lower_bound(chunks_->begin() + bound_chunk_ + 1, chunks_->end(), document_id, ChunkLess) - chunks_->begin();
+        bound_block_ = 0;
+    }
+    if (bound_chunk_ == chunks_->size()) {
+        return 0.0;
+    }
+    const auto& blocks = (*chunks_)[bound_chunk_].blocks;
+    bound_block_ = lower_bound(blocks.begin() + bound_block_, blocks.end(), document_id, BlockLess) - blocks.begin();
+    return blocks[bound_block_].max_term_freq;
+}
+
+int PostingsCursor::GetBlockLastDocumentId() const {
+    return bound_chunk_ < chunks_->size() ? (*chunks_)[bound_chunk_].blocks[bound_block_].last_document_id : numeric_limits<int>::max();
+}
+
+void PostingsCursor::LoadBlock() {
+    DecodePostingsBlock((*chunks_)[chunk_], block_, decoded_);
+}
+
+Posting InvertedIndex::GetPosting(int term_id, size_t n) const {
+    for (const PostingsChunk& chunk : postings_.at(term_id).chunks) {
+        if (!chunk.IsCompressed()) {
+            if (n < chunk.postings.size()) {
+                return chunk.postings[n];
+            }
+            n -= chunk.postings.size();
+            continue;
+        }
+        for (size_t block = 0; block < chunk.blocks.size(); ++block) {
+            if (n < chunk.blocks[block].size) {
+                DecodedPostingsBlock decoded;
+                DecodePostingsBlock(chunk, block, decoded);
+                return { decoded.document_ids[n], decoded.term_freqs[n] };
+            }
+            n -= chunk.blocks[block].size;
+        }
+    }
+    throw out_of_range("Posting index is out of range"s);
+}
+
+size_t InvertedIndex::GetDocumentFreq(int term_id) const {
+    return postings_.at(term_id).document_freq;
+}
+
+double InvertedIndex::GetInverseDocumentFreq(int term_id, int document_count, uint64_t generation) const {
+    const TermPostings& term_postings = postings_.at(term_id);
+    double inverse_document_freq;
+    if (!term_postings.inverse_document_freq.Get(generation, inverse_document_freq)) {
+        inverse_document_freq = log(document_count * 1.0 / term_postings.document_freq);
+        term_postings.inverse_document_freq.Set(generation, inverse_document_freq);
+    }
+    return inverse_document_freq;
+}
+
+size_t InvertedIndex::GetPostingCount(int term_id) const {
+    return postings_.at(term_id).posting_count;
+}
+
+double InvertedIndex::GetMaxTermFreq(int term_id) const {
+    return postings_.at(term_id).max_term_freq;
+}
+
+PostingsCursor InvertedIndex::GetCursor(int term_id) const {
+    return PostingsCursor(postings_.at(term_id).chunks);
+}
+
+bool InvertedIndex::ContainsDocument(int term_id, int document_id) const {
+    const auto& chunks = postings_.at(term_id).chunks;
+    const auto chunk = lower_bound(chunks.begin(), chunks.end(), document_id, ChunkLess);
+    if (chunk == chunks.end()) {
+        return false;
+    }
+    if (!chunk->IsCompressed()) {
+        const auto it = lower_bound(chunk->postings.begin(), chunk->postings.end(), document_id, PostingLess);
+        return it != chunk->postings.end() && it->document_id == document_id;
+    }
+    const size_t block = lower_bound(chunk->blocks.begin(), chunk->blocks.end(), document_id, BlockLess) - chunk->blocks.begin();
+    if (chunk->blocks[block].first_document_id > document_id) {
+        return false;
+    }
+    int document_ids[POSTINGS_BLOCK_SIZE];
+    DecodeDocumentIds(*chunk, block, document_ids);
+    return binary_search(document_ids, document_ids + chunk->blocks[block].size, document_id);
+}
+
+int InvertedIndex::AddPosting(const string_view& word, int document_id, double term_freq) {
+    const int term_id = AcquireTerm(word, 1);
+    TermPostings& term_postings = postings_[term_id];
+    PostingsChunk& chunk = GetOpenChunk(term_id);
+    auto& postings = chunk.postings;
+    // Documents are usually added with growing ids, so appending is the common case
+    auto it = postings.end();
+    if (!postings.empty() && postings.back().document_id > document_id) {
+        it = lower_bound(postings.begin(), postings.end(), document_id, PostingLess);
+    }
+    const auto inserted = postings.insert(it, { document_id, term_freq });
+    const size_t position = inserted - postings.begin();
+    term_postings.max_term_freq = max(term_postings.max_term_freq, term_freq);
+    ++term_postings.document_freq;
+    ++term_postings.posting_count;
+    if (position + 1 < postings.size()) {
+        UpdateBlocks(chunk, position);
+    }
+    else if (position % POSTINGS_BLOCK_SIZE == 0) {
+        chunk.blocks.push_back({ document_id, document_id, term_freq });
+    }
+    else {
+        // An appended posting only extends the last block
+        PostingsBlock& block = chunk.blocks.back();
+        block.last_document_id = document_id;
+        block.max_term_freq = max(block.max_term_freq, term_freq);
+    }
+    return term_id;
+}
+
+int InvertedIndex::AddPostings(const string_view& word, const vector<Posting>& new_postings) {
+    const int term_id = AcquireTerm(word, static_cast<int>(new_postings.size()));
+    TermPostings& term_postings = postings_[term_id];
+    PostingsChunk& chunk = GetOpenChunk(term_id);
+    auto& postings = chunk.postings;
+    size_t position = postings.size();
+    postings.insert(postings.end(), new_postings.begin(), new_postings.end());
+    if (position > 0 && position < postings.size() && postings[position].document_id < postings[position - 1].document_id) {
+        inplace_merge(postings.begin(), postings.begin() + position, postings.end(),
+            [](const Posting& lhs, const Posting& rhs) { return lhs.document_id < rhs.document_id; });
+        position = 0;
+    }
+    for (const Posting& posting : new_postings) {
+        term_postings.max_term_freq = max(term_postings.max_term_freq, posting.term_freq);
+    }
+    term_postings.document_freq += new_postings.size();
+    term_postings.posting_count += new_postings.size();
+    UpdateBlocks(chunk, position);
+    return term_id;
+}
+
+void InvertedIndex::SealSegmentIfFull(int end_document_id) {
+    if (end_document_id - open_segment_first_id_ >= SEGMENT_DOCUMENT_COUNT) {
+        SealSegment(end_document_id);
+    }
+}
+
+void InvertedIndex::MergeSegments(int end_document_id) {
+    if (end_document_id > open_segment_first_id_) {
+        SealSegment(end_document_id);
+    }
+    if (sealed_segments_.size() > 1) {
+        MergeSealedSegments(0);
+    }
+}
+
+void InvertedIndex::SetTermFreqQuantization(bool enabled) {
+    quantize_term_freqs_ = enabled;
+}
+
+bool InvertedIndex::IsTermFreqQuantized() const {
+    return quantize_term_freqs_;
+}
+
+size_t InvertedIndex::GetSegmentCount() const {
+    return sealed_segments_.size() + 1;
+}
+
+int InvertedIndex::GetOpenSegmentFirstId() const {
+    return open_segment_first_id_;
+}
+
+size_t InvertedIndex::GetPostingsMemoryUsage() const {
+    size_t bytes = postings_.capacity() * sizeof(TermPostings);
+    for (const TermPostings& term_postings : postings_) {
+        bytes += term_postings.chunks.capacity() * sizeof(PostingsChunk);
+        for (const PostingsChunk& chunk : term_postings.chunks) {
+            bytes += chunk.postings.capacity() * sizeof(Posting)
+                + chunk.blocks.capacity() * sizeof(PostingsBlock)
+                + chunk.packed.capacity() * sizeof(uint32_t);
+        }
+    }
+    return bytes;
+}
+
+void InvertedIndex::DecrementDocumentFreq(int term_id) {
+    --postings_.at(term_id).document_freq;
+}
+
+void InvertedIndex::ReleaseTerm(int term_id, int references) {
+    if (dictionary_.Release(term_id, references)) {
+        postings_[term_id] = {};
+    }
+}
+
+const TermDictionary& InvertedIndex::GetDictionary() const {
+    return dictionary_;
+}
+
+int InvertedIndex::AcquireTerm(const string_view& word, int references) {
+    const int term_id = dictionary_.Acquire(word, references);
+    if (postings_.size() < dictionary_.GetIdLimit()) {
+        postings_.resize(dictionary_.GetIdLimit());
+    }
+    return term_id;
+}
+
+PostingsChunk& InvertedIndex::GetOpenChunk(int term_id) {
+    auto& chunks = postings_[term_id].chunks;
+    // Sealed chunks are all compressed
+    if (chunks.empty() || chunks.back().IsCompressed()) {
+        chunks.emplace_back();
+        open_segment_terms_.push_back(term_id);
+    }
+    return chunks.back();
+}
+
+void InvertedIndex::SealSegment(int end_document_id) {
+    for (const int term_id : open_segment_terms_) {
+        TermPostings& term_postings = postings_[term_id];
+        // The term may have been released and its id reused since
+        if (term_postings.chunks.empty() || term_postings.chunks.back().IsCompressed()) {
+            continue;
+        }
+        PostingsChunk& chunk = term_postings.chunks.back();
+        const vector<Posting> postings = move(chunk.postings);
+        chunk = {};
+        chunk.quantized_term_freqs = quantize_term_freqs_;
+        AppendCompressedBlocks(chunk, postings);
+        chunk.packed.shrink_to_fit();
+        for (const PostingsBlock& block : chunk.blocks) {
+            // Quantization may round a frequency up
+            term_postings.max_term_freq = max(term_postings.max_term_freq, block.max_term_freq);
+        }
+    }
+    open_segment_terms_.clear();
+
+    sealed_segments_.push_back({ open_segment_first_id_, end_document_id, 0 });
+    open_segment_first_id_ = end_document_id;
+
+    // Like a binary counter: SEGMENT_MERGE_FACTOR segments of one tier make one of the next
+    while (sealed_segments_.size() >= SEGMENT_MERGE_FACTOR) {
+        const size_t first_segment = sealed_segments_.size() - SEGMENT_MERGE_FACTOR;
+        const int level = sealed_segments_.back().level;
+        if (sealed_segments_[first_segment].level != level) {
+            break;
+        }
+        MergeSealedSegments(first_segment);
+    }
+}
+
+void InvertedIndex::MergeSealedSegments(size_t first_segment) {
+    const int first_document_id = sealed_segments_[first_segment].first_document_id;
+    const int last_document_id = sealed_segments_.back().last_document_id;
+    int level = 0;
+    for (size_t segment = first_segment; segment < sealed_segments_.size(); ++segment) {
+        level = max(level, sealed_segments_[segment].level);
+    }
+    sealed_segments_.erase(sealed_segments_.begin() + first_segment, sealed_segments_.end());
+    sealed_segments_.push_back({ first_document_id, last_document_id, level + 1 });
+
+    for (TermPostings& term_postings : postings_) {
+        auto& chunks = term_postings.chunks;
+        const auto first = lower_bound(chunks.begin(), chunks.end(), first_document_id, ChunkLess);
+        const auto last = lower_bound(first, chunks.end(), last_document_id, ChunkLess);
+        if (last - first < 2) {
+            continue;
+        }
+        // Re-encoding evens out the short blocks that end every chunk. Stored term
+        // frequencies quantize to themselves, so quantized chunks lose no precision
+        vector<Posting> postings;
+        DecodedPostingsBlock decoded;
+        for (auto it = first; it != last; ++it) {
+            for (size_t block = 0; block < it->blocks.size(); ++block) {
+                DecodePostingsBlock(*it, block, decoded);
+                for (size_t i = 0; i < decoded.size; ++i) {
+                    postings.push_back({ decoded.document_ids[i], decoded.term_freqs[i] });
+                }
+            }
+        }
+        PostingsChunk merged;
+        merged.quantized_term_freqs = quantize_term_freqs_;
+        AppendCompressedBlocks(merged, postings);
+        merged.packed.shrink_to_fit();
+        *first = move(merged);
+        chunks.erase(first + 1, last);
+        chunks.shrink_to_fit();
+    }
+}
+
+void InvertedIndex::UpdateBlocks(PostingsChunk& chunk, size_t first_position) {
+    const auto& postings = chunk.postings;
+    auto& blocks = chunk.blocks;
+    blocks.resize((postings.size() + POSTINGS_BLOCK_SIZE - 1) / POSTINGS_BLOCK_SIZE);
+    for (size_t block = first_position / POSTINGS_BLOCK_SIZE; block < blocks.size(); ++block) {
+        const size_t first = block * POSTINGS_BLOCK_SIZE;
+        const size_t last = min(postings.size(), first + POSTINGS_BLOCK_SIZE);
+        double max_term_freq = 0.0;
+        for (size_t i = first; i < last; ++i) {
+            max_term_freq = max(max_term_freq, postings[i].term_freq);
+        }
+        blocks[block] = { postings[last - 1].document_id, postings[first].document_id, max_term_freq };
+    }
+}
+
+void InvertedIndex::AppendCompressedBlocks(PostingsChunk& chunk, const vector<Posting>& postings) {
+    for (size_t first = 0; first < postings.size(); first += POSTINGS_BLOCK_SIZE) {
+        const size_t size = min(POSTINGS_BLOCK_SIZE, postings.size() - first);
+        uint32_t gaps[POSTINGS_BLOCK_SIZE] = {};
+        uint32_t max_gap = 0;
+        for (size_t i = 1; i < size; ++i) {
+            gaps[i] = static_cast<uint32_t>(postings[first + i].document_id - postings[first + i - 1].document_id - 1);
+            max_gap = max(max_gap, gaps[i]);
+        }
+        PostingsBlock block = { postings[first + size - 1].document_id, postings[first].document_id, 0.0 };
+        block.offset = static_cast<uint32_t>(chunk.packed.size());
+        block.bit_width = static_cast<uint8_t>(GetBitWidth(max_gap));
+        block.size = static_cast<uint8_t>(size);
+        const size_t gap_word_count = GetPackedWordCount(block.bit_width, size);
+        const size_t term_freq_word_count = chunk.quantized_term_freqs ? (size + 1) / 2 : size * sizeof(double) / sizeof(uint32_t);
+        chunk.packed.resize(chunk.packed.size() + gap_word_count + term_freq_word_count);
+        PackBlock(gaps, size, block.bit_width, chunk.packed.data() + block.offset);
+
+        if (!chunk.quantized_term_freqs) {
+            double term_freqs[POSTINGS_BLOCK_SIZE];
+            for (size_t i = 0; i < size; ++i) {
+                term_freqs[i] = postings[first + i].term_freq;
+                block.max_term_freq = max(block.max_term_freq, term_freqs[i]);
+            }
+            memcpy(chunk.packed.data() + block.offset + gap_word_count, term_freqs, size * sizeof(double));
+            chunk.blocks.push_back(block);
+            continue;
+        }
+        uint16_t codes[POSTINGS_BLOCK_SIZE + 1] = {};
+        for (size_t i = 0; i < size; ++i) {
+            codes[i] = QuantizeTermFreq(postings[first + i].term_freq);
+            // The bound covers the stored frequencies, which is what queries read
+            block.max_term_freq = max(block.max_term_freq, DequantizeTermFreq(codes[i]));
+        }
+        memcpy(chunk.packed.data() + block.offset + gap_word_count, codes, (size + 1) / 2 * sizeof(uint32_t));
+        chunk.blocks.push_back(block);
+    }
+}
\ No newline at end of file
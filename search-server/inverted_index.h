@@ -0,0 +1,370 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "postings_codec.h"
+#include "term_dictionary.h"
+
+using namespace std;
+
+struct Posting {
+    int document_id;
+    double term_freq;
+};
+
+// Summary of up to POSTINGS_BLOCK_SIZE consecutive postings, used to skip blocks without
+// reading them. Blocks of compressed chunks also locate their packed postings
+struct PostingsBlock {
+    int last_document_id;
+    int first_document_id;
+    double max_term_freq;
+    // Compressed chunks only: the first word of the block in PostingsChunk::packed,
+    // the bit width of its id gaps and its posting count
+    uint32_t offset = 0;
+    uint8_t bit_width = 0;
+    uint8_t size = 0;
+};
+
+const size_t POSTINGS_BLOCK_SIZE = PACKED_BLOCK_SIZE;
+
+// A value readers compute on demand and keep until the generation moves on.
+// Readers of one generation always store the same value, so they may race on it freely
+class GenerationCachedValue {
+public:
+    GenerationCachedValue() = default;
+
+    GenerationCachedValue(const GenerationCachedValue& other) noexcept;
+
+    GenerationCachedValue& operator=(const GenerationCachedValue& other) noexcept;
+
+    bool Get(uint64_t generation, double& value) const;
+
+    void Set(uint64_t generation, double value) const;
+
+private:
+    // Generations start from 1, so a fresh cache never matches
+    mutable atomic<uint64_t> generation_{ 0 };
+    mutable atomic<double> value_{ 0.0 };
+};
+
+// Postings of one term inside one segment, sorted by document_id; never empty.
+// The open segment keeps plain postings. Sealing compresses them: every block then holds
+// bit-packed id gaps followed by the exact term frequencies, or by 16-bit ones (see
+// postings_codec.h) when the chunk is quantized, and postings is left empty.
+// A compressed block takes about 8 + bit_width / 8 bytes per posting instead of 16,
+// or 2 + bit_width / 8 when quantized
+struct PostingsChunk {
+    vector<Posting> postings;
+    vector<PostingsBlock> blocks;
+    vector<uint32_t> packed;
+    bool quantized_term_freqs = false;
+
+    bool IsCompressed() const {
+        return !packed.empty();
+    }
+};
+
+struct DecodedPostingsBlock {
+    array<int, POSTINGS_BLOCK_SIZE> document_ids;
+    array<double, POSTINGS_BLOCK_SIZE> term_freqs;
+    size_t size = 0;
+};
+
+// Copies or unpacks one block of the chunk
+void DecodePostingsBlock(const PostingsChunk& chunk, size_t block, DecodedPostingsBlock& decoded);
+
+// Unpacks only the document ids of a block of a compressed chunk
+void DecodeDocumentIds(const PostingsChunk& chunk, size_t block, int* document_ids);
+
+// Forward-only iterator over one postings list, across all of its segments
+class PostingsCursor {
+public:
+    explicit PostingsCursor(const vector<PostingsChunk>& chunks);
+
+    bool IsEnd() const;
+
+    int GetDocumentId() const;
+
+    double GetTermFreq() const;
+
+    void Next();
+
+    // Moves to the first posting with id not less than document_id
+    void SkipTo(int document_id);
+
+    // Max term frequency of the block that may hold document_id; moves only the block pointer
+    double GetBlockMaxTermFreq(int document_id);
+
+    // Last id of the block chosen by the previous GetBlockMaxTermFreq call
+    int GetBlockLastDocumentId() const;
+
+private:
+    const vector<PostingsChunk>* chunks_;
+    // The current posting: chunk, block inside it and position inside the decoded block
+    size_t chunk_ = 0;
+    size_t block_ = 0;
+    size_t position_ = 0;
+    DecodedPostingsBlock decoded_;
+    // Block found by GetBlockMaxTermFreq; never behind the current posting
+    size_t bound_chunk_ = 0;
+    size_t bound_block_ = 0;
+
+    void LoadBlock();
+};
+
+// Term -> postings index. Every term gets a dense integer id.
+// The index is split into segments, each covering a range of document ids. New postings go
+// to the open segment; sealed segments only change when they are merged or compacted.
+// Segments are sealed as documents arrive and merged in groups of SEGMENT_MERGE_FACTOR of
+// one size tier, so a term's postings are a handful of contiguous chunks, oldest first.
+class InvertedIndex {
+public:
+    static constexpr int NO_TERM = TermDictionary::NO_TERM;
+
+    // Documents the open segment takes before it is sealed
+    static constexpr int SEGMENT_DOCUMENT_COUNT = 8192;
+
+    static constexpr size_t SEGMENT_MERGE_FACTOR = 4;
+
+    int FindTerm(const string_view& word) const;
+
+    const string_view& GetTerm(int term_id) const;
+
+    // Calls action(document_id, term_freq) for the postings of the term, in document_id order
+    template <typename Action>
+    void ForEachPosting(int term_id, Action action) const;
+
+    // The same for document ids in [first_document_id, last_document_id)
+    template <typename Action>
+    void ForEachPosting(int term_id, int first_document_id, int last_document_id, Action action) const;
+
+    // The n-th posting of the term in document_id order
+    Posting GetPosting(int term_id, size_t n) const;
+
+    // Documents that still hold the term; postings of removed documents are not counted
+    size_t GetDocumentFreq(int term_id) const;
+
+    // Physical length of the postings list, removed documents included
+    size_t GetPostingCount(int term_id) const;
+
+    // Upper bound of the term frequency over the whole postings list
+    double GetMaxTermFreq(int term_id) const;
+
+    // log(document_count / document freq), computed once per generation of the caller.
+    // The caller bumps the generation whenever document_count or a document freq changes
+    double GetInverseDocumentFreq(int term_id, int document_count, uint64_t generation) const;
+
+    PostingsCursor GetCursor(int term_id) const;
+
+    bool ContainsDocument(int term_id, int document_id) const;
+
+    // Interns the word (one reference per document) and returns its term id.
+    // document_id must not precede the open segment
+    int AddPosting(const string_view& word, int document_id, double term_freq);
+
+    // Bulk form of AddPosting; new_postings must be sorted by document_id
+    int AddPostings(const string_view& word, const vector<Posting>& new_postings);
+
+    // Off by default. When on, segments sealed or merged from now on store 16-bit term
+    // frequencies, so their postings take about a quarter of the space; a frequency read
+    // back is then off by up to a relative 2^-12, and the open segment stays exact
+    void SetTermFreqQuantization(bool enabled);
+
+    bool IsTermFreqQuantized() const;
+
+    // Seals the open segment once it has taken SEGMENT_DOCUMENT_COUNT documents;
+    // documents from end_document_id on go to the next one
+    void SealSegmentIfFull(int end_document_id);
+
+    // Seals the open segment and merges all segments into one
+    void MergeSegments(int end_document_id);
+
+    // Sealed segments plus the open one
+    size_t GetSegmentCount() const;
+
+    // Documents from this id on are in the open segment
+    int GetOpenSegmentFirstId() const;
+
+    // Bytes taken by postings and their blocks
+    size_t GetPostingsMemoryUsage() const;
+
+    // Logical removal of one document holding the term; its posting stays until PurgePostings.
+    // Touches only that term, so different terms may be processed in parallel
+    void DecrementDocumentFreq(int term_id);
+
+    // Erases the postings whose document_id satisfies is_removed; same threading rules as above
+    template <typename RemovedPredicate>
+    void PurgePostings(int term_id, RemovedPredicate is_removed);
+
+    // Drops documents' references to the term; the last one frees the term and its postings
+    void ReleaseTerm(int term_id, int references = 1);
+
+    const TermDictionary& GetDictionary() const;
+
+private:
+    struct TermPostings {
+        vector<PostingsChunk> chunks;
+        size_t posting_count = 0;
+        double max_term_freq = 0.0;
+        size_t document_freq = 0;
+        GenerationCachedValue inverse_document_freq;
+    };
+
+    struct Segment {
+        int first_document_id;
+        int last_document_id;
+        int level;
+    };
+
+    TermDictionary dictionary_;
+
+    vector<TermPostings> postings_;
+
+    vector<Segment> sealed_segments_;
+
+    int open_segment_first_id_ = 0;
+
+    // Terms that got a chunk in the open segment, to be compressed when it is sealed
+    vector<int> open_segment_terms_;
+
+    bool quantize_term_freqs_ = false;
+
+    int AcquireTerm(const string_view& word, int references);
+
+    // The chunk of the open segment, created if the term has none yet
+    PostingsChunk& GetOpenChunk(int term_id);
+
+    void SealSegment(int end_document_id);
+
+    // Merges the sealed segments from first_segment on into one
+    void MergeSealedSegments(size_t first_segment);
+
+    static void UpdateBlocks(PostingsChunk& chunk, size_t first_position);
+
+    // Compresses postings sorted by document_id into new blocks at the end of the chunk,
+    // in the term frequency format of the chunk
+    static void AppendCompressedBlocks(PostingsChunk& chunk, const vector<Posting>& postings);
+};
+
+template <typename Action>
+void InvertedIndex::ForEachPosting(int term_id, Action action) const {
+    DecodedPostingsBlock decoded;
+    for (const PostingsChunk& chunk : postings_.at(term_id).chunks) {
+        if (!chunk.IsCompressed()) {
+            for (const Posting& posting : chunk.postings) {
+                action(posting.document_id, posting.term_freq);
+            }
+            continue;
+        }
+        for (size_t block = 0; block < chunk.blocks.size(); ++block) {
+            DecodePostingsBlock(chunk, block, decoded);
+            for (size_t i = 0; i < decoded.size; ++i) {
+                action(decoded.document_ids[i], decoded.term_freqs[i]);
+            }
+        }
+    }
+}
+
+template <typename Action>
+void InvertedIndex::ForEachPosting(int term_id, int first_document_id, int last_document_id, Action action) const {
+    const auto id_less = [](const Posting& posting, int document_id) { return posting.document_id < document_id; };
+    const auto block_less = [](const PostingsBlock& block, int document_id) { return block.last_document_id < document_id; };
+    DecodedPostingsBlock decoded;
+    for (const PostingsChunk& chunk : postings_.at(term_id).chunks) {
+        if (chunk.blocks.back().last_document_id < first_document_id) {
+            continue;
+        }
+        if (chunk.blocks.front().first_document_id >= last_document_id) {
+            break;
+        }
+        if (!chunk.IsCompressed()) {
+            const auto first = lower_bound(chunk.postings.begin(), chunk.postings.end(), first_document_id, id_less);
+            const auto last = lower_bound(first, chunk.postings.end(), last_document_id, id_less);
+            for (auto it = first; it != last; ++it) {
+                action(it->document_id, it->term_freq);
+            }
+            continue;
+        }
+        size_t block = lower_bound(chunk.blocks.begin(), chunk.blocks.end(), first_document_id, block_less) - chunk.blocks.begin();
+        for (; block < chunk.blocks.size() && chunk.blocks[block].first_document_id < last_document_id; ++block) {
+            DecodePostingsBlock(chunk, block, decoded);
+            const PostingsBlock& summary = chunk.blocks[block];
+            if (summary.first_document_id >= first_document_id && summary.last_document_id < last_document_id) {
+                for (size_t i = 0; i < decoded.size; ++i) {
+                    action(decoded.document_ids[i], decoded.term_freqs[i]);
+                }
+                continue;
+            }
+            for (size_t i = 0; i < decoded.size; ++i) {
+                const int document_id = decoded.document_ids[i];
+                if (document_id >= first_document_id && document_id < last_document_id) {
+                    action(document_id, decoded.term_freqs[i]);
+                }
+            }
+        }
+    }
+}
+
+template <typename RemovedPredicate>
+void InvertedIndex::PurgePostings(int term_id, RemovedPredicate is_removed) {
+    TermPostings& term_postings = postings_.at(term_id);
+    const auto posting_removed = [&is_removed](const Posting& posting) { return is_removed(posting.document_id); };
+    DecodedPostingsBlock decoded;
+    for (PostingsChunk& chunk : term_postings.chunks) {
+        if (!chunk.IsCompressed()) {
+            auto& postings = chunk.postings;
+            const auto first_removed = find_if(postings.begin(), postings.end(), posting_removed);
+            if (first_removed == postings.end()) {
+                continue;
+            }
+            const size_t position = first_removed - postings.begin();
+            const size_t old_size = postings.size();
+            postings.erase(remove_if(first_removed, postings.end(), posting_removed), postings.end());
+            term_postings.posting_count -= old_size - postings.size();
+            if (!postings.empty()) {
+                UpdateBlocks(chunk, position);
+            }
+            else {
+                chunk.blocks.clear();
+            }
+            continue;
+        }
+
+        // Blocks are rebuilt from the first one that holds a removed document
+        vector<Posting> kept;
+        size_t first_block = chunk.blocks.size();
+        for (size_t block = 0; block < chunk.blocks.size(); ++block) {
+            DecodePostingsBlock(chunk, block, decoded);
+            for (size_t i = 0; i < decoded.size; ++i) {
+                const bool removed = is_removed(decoded.document_ids[i]);
+                if (removed && first_block == chunk.blocks.size()) {
+                    first_block = block;
+                    for (size_t j = 0; j < i; ++j) {
+                        kept.push_back({ decoded.document_ids[j], decoded.term_freqs[j] });
+                    }
+                }
+                if (first_block != chunk.blocks.size() && !removed) {
+                    kept.push_back({ decoded.document_ids[i], decoded.term_freqs[i] });
+                }
+            }
+        }
+        if (first_block == chunk.blocks.size()) {
+            continue;
+        }
+        size_t old_size = 0;
+        for (size_t block = first_block; block < chunk.blocks.size(); ++block) {
+            old_size += chunk.blocks[block].size;
+        }
+        term_postings.posting_count -= old_size - kept.size();
+        chunk.packed.resize(chunk.blocks[first_block].offset);
+        chunk.blocks.resize(first_block);
+        AppendCompressedBlocks(chunk, kept);
+    }
+    auto& chunks = term_postings.chunks;
+    chunks.erase(remove_if(chunks.begin(), chunks.end(), [](const PostingsChunk& chunk) { return chunk.blocks.empty(); }), chunks.end());
+}
\ No newline at end of file
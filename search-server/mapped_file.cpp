@@ -0,0 +1,53 @@
+#include "mapped_file.h"
+
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_USE_MMAP
+#endif
+
+MappedFile::MappedFile(const string& path) {
+#ifdef MAPPED_FILE_USE_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            mapping_ = mapping;
+            data_ = static_cast<const char*>(mapping);
+            size_ = file_stat.st_size;
+        }
+    }
+    close(fd);
+#endif
+    if (mapping_ == nullptr) {
+        ifstream input(path, ios::binary);
+        if (!input) {
+            throw runtime_error("Cannot open file "s + path);
+        }
+        buffer_.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+    }
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAPPED_FILE_USE_MMAP
+    if (mapping_ != nullptr) {
+        munmap(mapping_, size_);
+    }
+#endif
+}
+
+string_view MappedFile::GetData() const {
+    return string_view(data_, size_);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Read-only contents of a whole file: mapped into memory where mmap is available,
+// read into a buffer otherwise
+class MappedFile {
+public:
+    explicit MappedFile(const string& path);
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    string_view GetData() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    void* mapping_ = nullptr;
+    vector<char> buffer_;
+};
\ No newline at end of file
@@ -0,0 +1,28 @@
+#include "matched_documents.h"
+
+MatchedDocuments::MatchedDocuments(vector<string_view> words, vector<size_t> offsets, vector<DocumentStatus> statuses)
+    : words_(move(words))
+    , offsets_(move(offsets))
+    , statuses_(move(statuses)) {
+}
+
+size_t MatchedDocuments::size() const {
+    return statuses_.size();
+}
+
+bool MatchedDocuments::empty() const {
+    return statuses_.empty();
+}
+
+IteratorRange<MatchedDocuments::Iterator> MatchedDocuments::GetWords(size_t index) const {
+    return { words_.begin() + offsets_.at(index), words_.begin() + offsets_.at(index + 1) };
+}
+
+DocumentStatus MatchedDocuments::GetStatus(size_t index) const {
+    return statuses_.at(index);
+}
+
+tuple<vector<string_view>, DocumentStatus> MatchedDocuments::operator[](size_t index) const {
+    const auto words = GetWords(index);
+    return { vector<string_view>(words.begin(), words.end()), statuses_[index] };
+}
\ No newline at end of file
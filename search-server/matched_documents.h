@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+using namespace std;
+
+// Words of one query matched in several documents, in one buffer, document after document
+class MatchedDocuments {
+public:
+    using Iterator = vector<string_view>::const_iterator;
+
+    MatchedDocuments(vector<string_view> words, vector<size_t> offsets, vector<DocumentStatus> statuses);
+
+    // Number of documents
+    size_t size() const;
+
+    bool empty() const;
+
+    // Matched words of a document in word order, as MatchDocument returns them
+    IteratorRange<Iterator> GetWords(size_t index) const;
+
+    DocumentStatus GetStatus(size_t index) const;
+
+    // The same result as MatchDocument, copied out of the buffer
+    tuple<vector<string_view>, DocumentStatus> operator[](size_t index) const;
+
+private:
+    vector<string_view> words_;
+    // Document i owns words_[offsets_[i], offsets_[i + 1])
+    vector<size_t> offsets_;
+    vector<DocumentStatus> statuses_;
+};
\ No newline at end of file
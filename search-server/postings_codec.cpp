@@ -0,0 +1,184 @@
+#include "postings_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int TERM_FREQ_MANTISSA_BITS = 11;
+const int DOUBLE_MANTISSA_BITS = 52;
+const int CODE_SHIFT = DOUBLE_MANTISSA_BITS - TERM_FREQ_MANTISSA_BITS;
+// Bit patterns of 2^-31, the smallest stored frequency, and of 1
+const uint64_t MIN_TERM_FREQ_BITS = uint64_t(1023 - 31) << DOUBLE_MANTISSA_BITS;
+const uint64_t MAX_TERM_FREQ_BITS = uint64_t(1023) << DOUBLE_MANTISSA_BITS;
+
+// Lanes of the interleaved layout, and values per lane
+const size_t PACKED_LANE_COUNT = 4;
+const size_t PACKED_ROW_COUNT = PACKED_BLOCK_SIZE / PACKED_LANE_COUNT;
+
+uint32_t GetBitMask(int bit_width) {
+    return bit_width == 32 ? ~0u : (1u << bit_width) - 1;
+}
+
+}
+
+uint16_t QuantizeTermFreq(double term_freq) {
+    uint64_t bits;
+    memcpy(&bits, &term_freq, sizeof(bits));
+    // Rounds the mantissa to nearest; a carry moves on into the exponent
+    bits += uint64_t(1) << (CODE_SHIFT - 1);
+    bits = clamp(bits, MIN_TERM_FREQ_BITS, MAX_TERM_FREQ_BITS);
+    return static_cast<uint16_t>((bits - MIN_TERM_FREQ_BITS) >> CODE_SHIFT);
+}
+
+double DequantizeTermFreq(uint16_t code) {
+    const uint64_t bits = (uint64_t(code) << CODE_SHIFT) + MIN_TERM_FREQ_BITS;
+    double term_freq;
+    memcpy(&term_freq, &bits, sizeof(term_freq));
+    return term_freq;
+}
+
+int GetBitWidth(uint32_t max_value) {
+    int bit_width = 0;
+    while (bit_width < 32 && (max_value >> bit_width) != 0) {
+        ++bit_width;
+    }
+    return bit_width;
+}
+
+size_t GetPackedWordCount(int bit_width, size_t count) {
+    if (count < PACKED_BLOCK_SIZE) {
+        return (count * bit_width + 31) / 32;
+    }
+    // Each lane takes PACKED_ROW_COUNT * bit_width bits, rounded up to whole words
+    return PACKED_LANE_COUNT * ((PACKED_ROW_COUNT * bit_width + 31) / 32);
+}
+
+void PackBlock(const uint32_t* values, size_t count, int bit_width, uint32_t* words) {
+    if (bit_width == 0) {
+        return;
+    }
+    memset(words, 0, GetPackedWordCount(bit_width, count) * sizeof(uint32_t));
+    // Full blocks are walked as PACKED_LANE_COUNT streams, short ones as a single stream
+    const size_t stride = count < PACKED_BLOCK_SIZE ? 1 : PACKED_LANE_COUNT;
+    for (size_t lane = 0; lane < stride; ++lane) {
+        for (size_t row = 0; row * stride + lane < count; ++row) {
+            const uint32_t value = values[row * stride + lane];
+            const size_t bit = row * bit_width;
+            const size_t word = bit / 32;
+            const size_t shift = bit % 32;
+            words[word * stride + lane] |= value << shift;
+            if (shift + bit_width > 32) {
+                words[(word + 1) * stride + lane] |= value >> (32 - shift);
+            }
+        }
+    }
+}
+
+void UnpackBlockScalar(const uint32_t* words, size_t count, int bit_width, uint32_t* values) {
+    if (bit_width == 0) {
+        memset(values, 0, count * sizeof(uint32_t));
+        return;
+    }
+    const uint32_t mask = GetBitMask(bit_width);
+    const size_t stride = count < PACKED_BLOCK_SIZE ? 1 : PACKED_LANE_COUNT;
+    for (size_t lane = 0; lane < stride; ++lane) {
+        for (size_t row = 0; row * stride + lane < count; ++row) {
+            const size_t bit = row * bit_width;
+            const size_t word = bit / 32;
+            const size_t shift = bit % 32;
+            uint32_t value = words[word * stride + lane] >> shift;
+            if (shift + bit_width > 32) {
+                value |= words[(word + 1) * stride + lane] << (32 - shift);
+            }
+            values[row * stride + lane] = value & mask;
+        }
+    }
+}
+
+#ifdef __SSE2__
+
+void UnpackBlock(const uint32_t* words, size_t count, int bit_width, uint32_t* values) {
+    if (count < PACKED_BLOCK_SIZE || bit_width == 0) {
+        UnpackBlockScalar(words, count, bit_width, values);
+        return;
+    }
+    const __m128i mask = _mm_set1_epi32(static_cast<int>(GetBitMask(bit_width)));
+    const __m128i* input = reinterpret_cast<const __m128i*>(words);
+    __m128i* output = reinterpret_cast<__m128i*>(values);
+    __m128i current = _mm_loadu_si128(input);
+    int shift = 0;
+    for (size_t row = 0; row < PACKED_ROW_COUNT; ++row) {
+        __m128i value = _mm_srl_epi32(current, _mm_cvtsi32_si128(shift));
+        shift += bit_width;
+        if (shift >= 32) {
+            shift -= 32;
+            // The last row may end exactly on the last word
+            if (shift > 0 || row + 1 < PACKED_ROW_COUNT) {
+                current = _mm_loadu_si128(++input);
+            }
+            if (shift > 0) {
+                value = _mm_or_si128(value, _mm_sll_epi32(current, _mm_cvtsi32_si128(bit_width - shift)));
+            }
+        }
+        _mm_storeu_si128(output + row, _mm_and_si128(value, mask));
+    }
+}
+
+void DecodeGaps(const uint32_t* gaps, int first_id, int* ids) {
+    const __m128i* input = reinterpret_cast<const __m128i*>(gaps);
+    __m128i* output = reinterpret_cast<__m128i*>(ids);
+    const __m128i ones = _mm_set1_epi32(1);
+    // Every value adds its gap plus one to the previous id, the first one included
+    __m128i carry = _mm_set1_epi32(first_id - 1);
+    for (size_t row = 0; row < PACKED_ROW_COUNT; ++row) {
+        __m128i steps = _mm_add_epi32(_mm_loadu_si128(input + row), ones);
+        steps = _mm_add_epi32(steps, _mm_slli_si128(steps, 4));
+        steps = _mm_add_epi32(steps, _mm_slli_si128(steps, 8));
+        const __m128i row_ids = _mm_add_epi32(steps, carry);
+        _mm_storeu_si128(output + row, row_ids);
+        carry = _mm_shuffle_epi32(row_ids, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+}
+
+void DequantizeTermFreqs(const uint16_t* codes, size_t count, double* term_freqs) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i offset = _mm_set1_epi64x(static_cast<long long>(MIN_TERM_FREQ_BITS));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i codes32 = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes + i)), zero);
+        const __m128i low = _mm_add_epi64(_mm_slli_epi64(_mm_unpacklo_epi32(codes32, zero), CODE_SHIFT), offset);
+        const __m128i high = _mm_add_epi64(_mm_slli_epi64(_mm_unpackhi_epi32(codes32, zero), CODE_SHIFT), offset);
+        _mm_storeu_pd(term_freqs + i, _mm_castsi128_pd(low));
+        _mm_storeu_pd(term_freqs + i + 2, _mm_castsi128_pd(high));
+    }
+    for (; i < count; ++i) {
+        term_freqs[i] = DequantizeTermFreq(codes[i]);
+    }
+}
+
+#else
+
+void UnpackBlock(const uint32_t* words, size_t count, int bit_width, uint32_t* values) {
+    UnpackBlockScalar(words, count, bit_width, values);
+}
+
+void DecodeGaps(const uint32_t* gaps, int first_id, int* ids) {
+    int id = first_id - 1;
+    for (size_t i = 0; i < PACKED_BLOCK_SIZE; ++i) {
+        id += static_cast<int>(gaps[i]) + 1;
+        ids[i] = id;
+    }
+}
+
+void DequantizeTermFreqs(const uint16_t* codes, size_t count, double* term_freqs) {
+    for (size_t i = 0; i < count; ++i) {
+        term_freqs[i] = DequantizeTermFreq(codes[i]);
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Building blocks of the compressed postings of sealed index segments
+
+// Values in one bit-packed block
+const size_t PACKED_BLOCK_SIZE = 64;
+
+// Term frequencies are stored as 16-bit floats without a sign: 5 exponent bits and 11
+// mantissa bits, rounded to nearest. A stored frequency is within a relative 2^-12
+// (about 0.025%) of the original one for every value down to 2^-31, and frequencies
+// never exceed 1. Relevance is a sum of term_freq * idf with non-negative idf, so a
+// relevance computed from stored frequencies keeps the same relative bound.
+// Stored values are exact 16-bit floats, so quantizing one again does not change it.
+// A code is the top of the double bit pattern minus a constant exponent offset, so
+// decoding is a shift and an add
+uint16_t QuantizeTermFreq(double term_freq);
+
+double DequantizeTermFreq(uint16_t code);
+
+// Bulk form of DequantizeTermFreq
+void DequantizeTermFreqs(const uint16_t* codes, size_t count, double* term_freqs);
+
+// Bits needed for the largest value
+int GetBitWidth(uint32_t max_value);
+
+// 32-bit words taken by count values of bit_width bits, as packed by PackBlock
+size_t GetPackedWordCount(int bit_width, size_t count);
+
+// A full block of PACKED_BLOCK_SIZE values is interleaved: value i goes to lane i % 4 of
+// four 32-bit streams, so one 128-bit register unpacks four values per step. Shorter
+// blocks, which only end postings lists, store their values as consecutive bits.
+// Values must fit into bit_width bits
+void PackBlock(const uint32_t* values, size_t count, int bit_width, uint32_t* words);
+
+// Fills the first count values. A full block uses SSE2 when the target has it
+void UnpackBlock(const uint32_t* words, size_t count, int bit_width, uint32_t* values);
+
+// The same without SIMD
+void UnpackBlockScalar(const uint32_t* words, size_t count, int bit_width, uint32_t* values);
+
+// Turns unpacked gaps into ids: ids[i] = first_id + i + gaps[1] + ... + gaps[i].
+// gaps[0] must be zero
+void DecodeGaps(const uint32_t* gaps, int first_id, int* ids);
\ No newline at end of file
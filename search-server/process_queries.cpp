@@ -1,33 +1,45 @@
 #include "process_queries.h"
 
-vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
-    vector<vector<Document>> results(queries.size());
+JoinedDocuments::JoinedDocuments(vector<Document> documents, vector<size_t> offsets)
+    : documents_(move(documents))
+    , offsets_(move(offsets)) {
+}
+
+JoinedDocuments::Iterator JoinedDocuments::begin() const {
+    return documents_.begin();
+}
+
+JoinedDocuments::Iterator JoinedDocuments::end() const {
+    return documents_.end();
+}
 
-    transform(execution::par, queries.begin(), queries.end(), results.begin(), [&search_server](const auto& query) {
-        return search_server.FindTopDocuments(query);
-        });
-    return results;
+size_t JoinedDocuments::size() const {
+    return documents_.size();
 }
 
-vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
-    std::vector<std::vector<Document>> results(queries.size());
+bool JoinedDocuments::empty() const {
+    return documents_.empty();
+}
 
-    std::transform(std::execution::par, queries.begin(), queries.end(), results.begin(), [&search_server](const auto& query) {
-        return search_server.FindTopDocuments(query);
-        });
+const Document& JoinedDocuments::operator[](size_t index) const {
+    return documents_[index];
+}
 
-    size_t total_documents = 0;
-    for (const auto& result : results) {
-        total_documents += result.size();
-    }
+size_t JoinedDocuments::GetQueryCount() const {
+    return offsets_.size() - 1;
+}
 
-    std::vector<Document> vec;
-    vec.reserve(total_documents);
+IteratorRange<JoinedDocuments::Iterator> JoinedDocuments::GetQueryDocuments(size_t query_index) const {
+    return { documents_.begin() + offsets_.at(query_index), documents_.begin() + offsets_.at(query_index + 1) };
+}
 
-    // Flatten the results into a single vector
-    for (const auto& result : results) {
-        vec.insert(vec.end(), result.begin(), result.end());
-    }
+vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries) {
+    return search_server.FindTopDocumentsBatch(queries);
+}
 
-    return vec;
+JoinedDocuments ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries) {
+    vector<Document> documents;
+    vector<size_t> offsets;
+    search_server.FindTopDocumentsBatch(queries, documents, offsets);
+    return JoinedDocuments(move(documents), move(offsets));
 }
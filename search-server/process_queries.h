@@ -4,10 +4,40 @@
 #include <algorithm>
 #include <string>
 #include "document.h"
+#include "paginator.h"
 #include "search_server.h"
 
 using namespace std;
 
+// Results of a batch of queries in one buffer, query after query
+class JoinedDocuments {
+public:
+    using Iterator = vector<Document>::const_iterator;
+
+    JoinedDocuments(vector<Document> documents, vector<size_t> offsets);
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    const Document& operator[](size_t index) const;
+
+    size_t GetQueryCount() const;
+
+    // The documents found by one query
+    IteratorRange<Iterator> GetQueryDocuments(size_t query_index) const;
+
+private:
+    vector<Document> documents_;
+    // Query i owns documents_[offsets_[i], offsets_[i + 1])
+    vector<size_t> offsets_;
+};
+
 vector<vector<Document>> ProcessQueries(const SearchServer& search_server, const vector<string>& queries);
 
-vector<Document> ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries);
\ No newline at end of file
+// Every query writes its documents straight into the joined buffer
+JoinedDocuments ProcessQueriesJoined(const SearchServer& search_server, const vector<string>& queries);
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include "query_cache.h"
+
+QueryResultCache::QueryResultCache(const SearchServer& search_server, size_t capacity)
+    : search_server_(search_server)
+    , capacity_(capacity) {
+    entries_.reserve(capacity);
+    entry_indices_.reserve(capacity);
+}
+
+vector<Document> QueryResultCache::FindTopDocuments(const string_view& raw_query, DocumentStatus status, size_t max_count) {
+    return FindTopDocuments(execution::seq, raw_query, status, max_count);
+}
+
+uint64_t QueryResultCache::GetHitCount() const {
+    return hit_count_;
+}
+
+uint64_t QueryResultCache::GetMissCount() const {
+    return miss_count_;
+}
+
+size_t QueryResultCache::GetSize() const {
+    lock_guard guard(mutex_);
+    return entries_.size();
+}
+
+void QueryResultCache::Clear() {
+    lock_guard guard(mutex_);
+    entries_.clear();
+    entry_indices_.clear();
+    clock_hand_ = 0;
+}
+
+size_t QueryResultCache::KeyHasher::operator()(const Key& key) const {
+    const size_t hash = std::hash<string>()(key.query);
+    return hash ^ (static_cast<size_t>(key.status) + key.max_count * 0x9E3779B97F4A7C15ULL);
+}
+
+bool QueryResultCache::Find(const Key& key, uint64_t generation, vector<Document>& documents) {
+    lock_guard guard(mutex_);
+    const auto it = entry_indices_.find(key);
+    if (it == entry_indices_.end()) {
+        return false;
+    }
+    Entry& entry = entries_[it->second];
+    // A stale entry keeps its slot until Store refreshes it
+    if (entry.generation != generation) {
+        return false;
+    }
+    entry.is_referenced = true;
+    documents = entry.documents;
+    return true;
+}
+
+void QueryResultCache::Store(Key&& key, uint64_t generation, const vector<Document>& documents) {
+    if (capacity_ == 0) {
+        return;
+    }
+    lock_guard guard(mutex_);
+    const auto it = entry_indices_.find(key);
+    if (it != entry_indices_.end()) {
+        Entry& entry = entries_[it->second];
+        // Another thread may have stored a newer result meanwhile
+        if (entry.generation <= generation) {
+            entry.documents = documents;
+            entry.generation = generation;
+        }
+        return;
+    }
+
+    size_t index = entries_.size();
+    if (entries_.size() < capacity_) {
+        entries_.push_back({});
+    }
+    else {
+        // Gives every referenced entry a second chance, so this ends within two turns
+        while (entries_[clock_hand_].is_referenced) {
+            entries_[clock_hand_].is_referenced = false;
+            clock_hand_ = (clock_hand_ + 1) % capacity_;
+        }
+        index = clock_hand_;
+        clock_hand_ = (clock_hand_ + 1) % capacity_;
+        entry_indices_.erase(entries_[index].key);
+    }
+    Entry& entry = entries_[index];
+    entry.key = move(key);
+    entry.documents = documents;
+    entry.generation = generation;
+    entry.is_referenced = false;
+    entry_indices_.emplace(entry.key, index);
+}
\ No newline at end of file
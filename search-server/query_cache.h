@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <execution>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+using namespace std;
+
+// Results of FindTopDocuments kept for repeated queries. Entries are keyed on the
+// normalized query (see SearchServer::NormalizeQuery), the status and the number of
+// documents asked for, and remember the index generation they were found at: once a
+// document is added or removed, they are found again on the next request.
+// Capacity is in entries; the one evicted is picked by CLOCK, so a hit only marks its
+// entry instead of reordering a list. Safe to call from several threads, as long as the
+// server itself is not changed meanwhile
+class QueryResultCache {
+public:
+    QueryResultCache(const SearchServer& search_server, size_t capacity);
+
+    vector<Document> FindTopDocuments(const string_view& raw_query, DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = MAX_RESULT_DOCUMENT_COUNT);
+
+    // The policy is used for the queries that miss
+    template <typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = MAX_RESULT_DOCUMENT_COUNT);
+
+    uint64_t GetHitCount() const;
+
+    uint64_t GetMissCount() const;
+
+    size_t GetSize() const;
+
+    void Clear();
+
+private:
+    struct Key {
+        string query;
+        DocumentStatus status;
+        size_t max_count;
+
+        bool operator==(const Key& other) const {
+            return query == other.query && status == other.status && max_count == other.max_count;
+        }
+    };
+
+    struct KeyHasher {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        Key key;
+        vector<Document> documents;
+        uint64_t generation = 0;
+        // Set by a hit, cleared when the clock hand passes
+        bool is_referenced = false;
+    };
+
+    const SearchServer& search_server_;
+
+    size_t capacity_;
+
+    mutable mutex mutex_;
+
+    vector<Entry> entries_;
+
+    unordered_map<Key, size_t, KeyHasher> entry_indices_;
+
+    size_t clock_hand_ = 0;
+
+    atomic<uint64_t> hit_count_{ 0 };
+
+    atomic<uint64_t> miss_count_{ 0 };
+
+    // Fills documents and returns true on a hit of the current generation
+    bool Find(const Key& key, uint64_t generation, vector<Document>& documents);
+
+    void Store(Key&& key, uint64_t generation, const vector<Document>& documents);
+};
+
+template <typename ExecutionPolicy>
+vector<Document> QueryResultCache::FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentStatus status, size_t max_count) {
+    Key key{ search_server_.NormalizeQuery(raw_query), status, max_count };
+    const uint64_t generation = search_server_.GetGeneration();
+    vector<Document> documents;
+    if (Find(key, generation, documents)) {
+        ++hit_count_;
+        return documents;
+    }
+    ++miss_count_;
+    documents = search_server_.FindTopDocuments(policy, raw_query, status, max_count);
+    Store(move(key), generation, documents);
+    return documents;
+}
\ No newline at end of file
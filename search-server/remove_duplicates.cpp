@@ -1,35 +1,230 @@
 #include "remove_duplicates.h"
 
+namespace {
+
+// MinHash values per document in near-duplicate mode, cut into bands of rows
+const int MINHASH_COUNT = 128;
+
+// Probability that a pair right at the threshold shares at least one band
+const double MIN_CANDIDATE_PROBABILITY = 0.99;
+
+// Groups of one bucket a candidate is checked against; bounds the work of a bucket
+// of many dissimilar candidates to linear
+const size_t MAX_BUCKET_REPRESENTATIVES = 32;
+
+// One step of splitmix64; unlike the bare finalizer it does not map zero to zero
+uint64_t MixBits(uint64_t value) {
+    value += 0x9E3779B97F4A7C15ULL;
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ULL;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBULL;
+    value ^= value >> 31;
+    return value;
+}
+
+uint64_t HashValues(const uint32_t* values, size_t count) {
+    uint64_t hash = MixBits(count);
+    for (size_t i = 0; i < count; ++i) {
+        hash = MixBits(hash ^ values[i]);
+    }
+    return hash;
+}
+
+// Both term id lists are sorted
+bool IsSimilar(const vector<int>& lhs, const vector<int>& rhs, double threshold) {
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < lhs.size() && j < rhs.size();) {
+        if (lhs[i] < rhs[j]) {
+            ++i;
+        }
+        else if (rhs[j] < lhs[i]) {
+            ++j;
+        }
+        else {
+            ++common;
+            ++i;
+            ++j;
+        }
+    }
+    return static_cast<double>(common) >= threshold * static_cast<double>(lhs.size() + rhs.size() - common);
+}
+
+// Fewest bands, i.e. fewest false candidates, that still find a pair at the threshold
+// often enough. Returns the number of bands and of rows per band
+pair<int, int> ChooseBands(double threshold) {
+    pair<int, int> bands = { MINHASH_COUNT, 1 };
+    for (int row_count = 2; row_count <= MINHASH_COUNT; ++row_count) {
+        const int band_count = MINHASH_COUNT / row_count;
+        if (1.0 - pow(1.0 - pow(threshold, row_count), band_count) >= MIN_CANDIDATE_PROBABILITY) {
+            bands = { band_count, row_count };
+        }
+    }
+    return bands;
+}
+
+// Union-find over positions; a group is named by its lowest position
+class DocumentGroups {
+public:
+    explicit DocumentGroups(size_t document_count)
+        : parents_(document_count) {
+        iota(parents_.begin(), parents_.end(), 0);
+    }
+
+    int Find(int position) {
+        while (parents_[position] != position) {
+            parents_[position] = parents_[parents_[position]];
+            position = parents_[position];
+        }
+        return position;
+    }
+
+    void Join(int lhs, int rhs) {
+        lhs = Find(lhs);
+        rhs = Find(rhs);
+        parents_[max(lhs, rhs)] = min(lhs, rhs);
+    }
+
+private:
+    vector<int> parents_;
+};
+
+void RemoveReported(SearchServer& search_server, const vector<int>& duplicate_ids) {
+    for (const int document_id : duplicate_ids) {
+        search_server.RemoveDocument(document_id);
+        std::cout << "Found duplicate document id " << document_id << endl;
+    }
+}
+
+}
+
 void RemoveDuplicates(SearchServer& search_server) {
-    set<set<string_view>> unique_words;
+    const vector<int> document_ids(search_server.begin(), search_server.end());
+
+    // Hash and position of every document with words; empty documents are never duplicates
+    vector<pair<uint64_t, int>> signatures(document_ids.size());
+    vector<char> has_words(document_ids.size());
+    search_server.GetThreadPool().ParallelFor(document_ids.size(), [&](size_t position) {
+        const vector<int> term_ids = search_server.GetDocumentTermIds(document_ids[position]);
+        const vector<uint32_t> values(term_ids.begin(), term_ids.end());
+        signatures[position] = { HashValues(values.data(), values.size()), static_cast<int>(position) };
+        has_words[position] = !term_ids.empty();
+    });
+    signatures.erase(remove_if(signatures.begin(), signatures.end(), [&has_words](const auto& signature) {
+        return !has_words[signature.second];
+    }), signatures.end());
+    sort(execution::par, signatures.begin(), signatures.end());
+
+    // Within a run of equal hashes positions ascend, so the first of each word set is kept
     vector<int> duplicate_ids;
+    vector<vector<int>> kept_term_ids;
+    for (size_t first = 0, last = 0; first < signatures.size(); first = last) {
+        while (last < signatures.size() && signatures[last].first == signatures[first].first) {
+            ++last;
+        }
+        if (last - first == 1) {
+            continue;
+        }
+        kept_term_ids.clear();
+        for (size_t i = first; i < last; ++i) {
+            const int document_id = document_ids[signatures[i].second];
+            vector<int> term_ids = search_server.GetDocumentTermIds(document_id);
+            if (find(kept_term_ids.begin(), kept_term_ids.end(), term_ids) != kept_term_ids.end()) {
+                duplicate_ids.push_back(document_id);
+            }
+            else {
+                kept_term_ids.push_back(move(term_ids));
+            }
+        }
+    }
+    sort(duplicate_ids.begin(), duplicate_ids.end());
+    RemoveReported(search_server, duplicate_ids);
+}
 
-    for (const int document_id : search_server) {
-        const auto& freqs = search_server.GetWordFrequencies(document_id);
-        if (!freqs.empty()) {
-            vector<string_view> words;
-            words.reserve(freqs.size());
+void RemoveNearDuplicates(SearchServer& search_server, double threshold) {
+    if (!(threshold > 0.0 && threshold <= 1.0)) {
+        throw invalid_argument("Similarity threshold must be in (0, 1]"s);
+    }
+    const auto [band_count, row_count] = ChooseBands(threshold);
+    const vector<int> document_ids(search_server.begin(), search_server.end());
 
-            std::transform(freqs.begin(), freqs.end(), std::back_inserter(words), [](const pair<string_view, double> p) {
-                return p.first;
-                });
+    // Band hashes of every document, band_count per document; the i-th MinHash value
+    // takes the minimum of h1 + i * h2 over the terms, two hashes of the term id
+    vector<uint64_t> band_hashes(document_ids.size() * band_count);
+    vector<char> has_words(document_ids.size());
+    search_server.GetThreadPool().ParallelFor(document_ids.size(), [&, band_count = band_count, row_count = row_count](size_t position) {
+        const vector<int> term_ids = search_server.GetDocumentTermIds(document_ids[position]);
+        has_words[position] = !term_ids.empty();
+        vector<uint32_t> minimums(band_count * row_count, UINT32_MAX);
+        for (const int term_id : term_ids) {
+            const uint64_t first_hash = MixBits(static_cast<uint64_t>(term_id));
+            const uint64_t second_hash = MixBits(first_hash) | 1;
+            uint64_t hash = first_hash;
+            for (uint32_t& minimum : minimums) {
+                minimum = min(minimum, static_cast<uint32_t>(hash >> 32));
+                hash += second_hash;
+            }
+        }
+        for (int band = 0; band < band_count; ++band) {
+            band_hashes[position * band_count + band] = HashValues(minimums.data() + band * row_count, row_count);
+        }
+    });
 
-            set<string_view> joined_words;
-            for (const auto& word : words) {
-                joined_words.insert(word);
+    DocumentGroups groups(document_ids.size());
+    vector<pair<uint64_t, int>> buckets;
+    // Earliest candidate of each group met in the bucket, with its term ids
+    vector<pair<int, vector<int>>> representatives;
+    for (int band = 0; band < band_count; ++band) {
+        buckets.clear();
+        for (size_t position = 0; position < document_ids.size(); ++position) {
+            if (has_words[position]) {
+                buckets.push_back({ band_hashes[position * band_count + band], static_cast<int>(position) });
             }
+        }
+        sort(execution::par, buckets.begin(), buckets.end());
 
-            if (unique_words.count(joined_words) > 0) {
-                duplicate_ids.push_back(document_id);
+        // Candidates share a bucket; each one is checked against one candidate of every
+        // other group met so far, so a large cluster costs a pass, not all its pairs
+        for (size_t first = 0, last = 0; first < buckets.size(); first = last) {
+            while (last < buckets.size() && buckets[last].first == buckets[first].first) {
+                ++last;
             }
-            else {
-                unique_words.insert(joined_words);
+            if (last - first == 1) {
+                continue;
+            }
+            representatives.clear();
+            for (size_t i = first; i < last; ++i) {
+                const int position = buckets[i].second;
+                vector<int> term_ids;
+                bool is_represented = false;
+                for (const auto& [other, other_term_ids] : representatives) {
+                    if (groups.Find(other) == groups.Find(position)) {
+                        is_represented = true;
+                        continue;
+                    }
+                    if (term_ids.empty()) {
+                        term_ids = search_server.GetDocumentTermIds(document_ids[position]);
+                    }
+                    if (IsSimilar(other_term_ids, term_ids, threshold)) {
+                        groups.Join(other, position);
+                        is_represented = true;
+                    }
+                }
+                if (!is_represented && representatives.size() < MAX_BUCKET_REPRESENTATIVES) {
+                    if (term_ids.empty()) {
+                        term_ids = search_server.GetDocumentTermIds(document_ids[position]);
+                    }
+                    representatives.push_back({ position, move(term_ids) });
+                }
             }
         }
     }
 
-    for (auto it = duplicate_ids.begin(); it != duplicate_ids.end(); ++it) {
-        search_server.RemoveDocument(*it);
-        std::cout << "Found duplicate document id " << *it << endl;
+    vector<int> duplicate_ids;
+    for (size_t position = 0; position < document_ids.size(); ++position) {
+        if (groups.Find(static_cast<int>(position)) != static_cast<int>(position)) {
+            duplicate_ids.push_back(document_ids[position]);
+        }
     }
+    RemoveReported(search_server, duplicate_ids);
 }
\ No newline at end of file
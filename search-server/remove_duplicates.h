@@ -4,4 +4,16 @@
 #include <map>
 #include <vector>
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+// Removes every document with the same set of words as a document of a lower id and
+// reports it. Documents are compared by a hash of their sorted term ids, computed in
+// parallel; documents whose hashes collide are compared term by term
+void RemoveDuplicates(SearchServer& search_server);
+
+// Near-duplicate mode: documents whose word sets have a Jaccard similarity of at least
+// threshold, which must be in (0, 1], are grouped, and every group keeps its lowest id.
+// Candidates come from MinHash signatures cut into LSH bands, sized so that a pair right
+// at the threshold is found with a probability of at least 99% (closer pairs more likely);
+// candidates are confirmed on their exact word sets. A candidate is compared with one
+// earlier candidate per group of its bucket, at most 32 of them, so a pair whose
+// similarity shows only through other members of a group may be missed
+void RemoveNearDuplicates(SearchServer& search_server, double threshold = 0.8);
\ No newline at end of file
@@ -6,6 +6,11 @@ RequestQueue::RequestQueue(const SearchServer& search_server)
     , current_time_(0) {
 }
 
+RequestQueue::RequestQueue(const SearchServer& search_server, QueryResultCache& cache)
+    : RequestQueue(search_server) {
+    cache_ = &cache;
+}
+
 void RequestQueue::AddRequest(int results_num) {
     ++current_time_;
     while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
@@ -21,13 +26,13 @@ void RequestQueue::AddRequest(int results_num) {
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
+    const auto result = cache_ ? cache_->FindTopDocuments(raw_query, status) : search_server_.FindTopDocuments(raw_query, status);
     AddRequest(result.size());
     return result;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const string_view& raw_query) {
-    const auto result = search_server_.FindTopDocuments(raw_query);
+    const auto result = cache_ ? cache_->FindTopDocuments(raw_query) : search_server_.FindTopDocuments(raw_query);
     AddRequest(result.size());
     return result;
 }
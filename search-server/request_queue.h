@@ -1,5 +1,6 @@
 #pragma once
 #include "search_server.h"
+#include "query_cache.h"
 
 using namespace std;
 
@@ -7,6 +8,9 @@ class RequestQueue {
 public:
     explicit RequestQueue(const SearchServer& search_server);
 
+    // Requests by status are answered through the cache, which must be of the same server
+    RequestQueue(const SearchServer& search_server, QueryResultCache& cache);
+
     vector<Document> AddFindRequest(const string_view& raw_query, DocumentStatus status);
 
     vector<Document> AddFindRequest(const string_view& raw_query);
@@ -23,6 +27,8 @@ private:
 
     const SearchServer& search_server_;
 
+    QueryResultCache* cache_ = nullptr;
+
     int no_results_requests_;
 
     uint64_t current_time_;
@@ -34,7 +40,7 @@ private:
 public:
     template <typename DocumentPredicate>
     vector<Document> AddFindRequest(const string_view& raw_query, DocumentPredicate document_predicate) {
-        const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
+        const auto result = search_server_.FindTopDocuments(execution::seq, raw_query, document_predicate);
         AddRequest(result.size());
         return result;
     }
@@ -0,0 +1,25 @@
+#pragma once
+
+// Top-K retrieval strategies that can be passed to SearchServer::FindTopDocuments
+// in place of an execution policy. They return the same documents as exhaustive
+// scoring but skip postings of documents that cannot reach the result.
+namespace retrieval {
+
+// Skips documents whose summed per-term upper bounds cannot beat the current top
+struct WandPolicy {};
+
+// WAND refined with per-block upper bounds of every postings list
+struct BlockMaxWandPolicy {};
+
+// Not a top-K strategy: scores exhaustively, sequentially or split into parts, depending
+// on the postings the query reads. Also accepted by MatchDocument and MatchDocuments.
+// See SearchServer::GetAdaptiveExecutionStats
+struct AdaptivePolicy {};
+
+inline constexpr WandPolicy wand{};
+
+inline constexpr BlockMaxWandPolicy block_max_wand{};
+
+inline constexpr AdaptivePolicy adaptive{};
+
+}
\ No newline at end of file
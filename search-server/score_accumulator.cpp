@@ -0,0 +1,72 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+#include <thread>
+
+void ScoreAccumulator::Reset(size_t document_count) {
+    if (stamps_.size() < document_count) {
+        stamps_.resize(document_count, 0);
+        scores_.resize(document_count);
+    }
+    // Each generation takes two stamp values: scored and excluded
+    generation_ += 2;
+    if (generation_ < 2) {
+        // Stamps could collide with the new generation after a wrap-around
+        fill(stamps_.begin(), stamps_.end(), 0);
+        generation_ = 2;
+    }
+}
+
+ScoreAccumulatorPool::ScoreAccumulatorPool(size_t max_idle_count)
+    : max_idle_count_(max_idle_count > 0 ? max_idle_count : max(1u, thread::hardware_concurrency())) {
+}
+
+unique_ptr<ScoreAccumulator> ScoreAccumulatorPool::Acquire() {
+    {
+        lock_guard guard(mutex_);
+        if (!idle_.empty()) {
+            unique_ptr<ScoreAccumulator> accumulator = move(idle_.back());
+            idle_.pop_back();
+            return accumulator;
+        }
+    }
+    return make_unique<ScoreAccumulator>();
+}
+
+void ScoreAccumulatorPool::Release(unique_ptr<ScoreAccumulator> accumulator) {
+    lock_guard guard(mutex_);
+    // Otherwise the accumulator is freed with the parameter, after the lock is released
+    if (idle_.size() < max_idle_count_) {
+        idle_.push_back(move(accumulator));
+    }
+}
+
+void ScoreAccumulatorPool::Clear() {
+    vector<unique_ptr<ScoreAccumulator>> idle;
+    {
+        lock_guard guard(mutex_);
+        idle.swap(idle_);
+    }
+}
+
+size_t ScoreAccumulatorPool::GetIdleCount() const {
+    lock_guard guard(mutex_);
+    return idle_.size();
+}
+
+ScoreAccumulatorLease::ScoreAccumulatorLease(ScoreAccumulatorPool& pool)
+    : pool_(pool)
+    , accumulator_(pool.Acquire()) {
+}
+
+ScoreAccumulatorLease::~ScoreAccumulatorLease() {
+    pool_.Release(move(accumulator_));
+}
+
+ScoreAccumulator& ScoreAccumulatorLease::operator*() const {
+    return *accumulator_;
+}
+
+ScoreAccumulator* ScoreAccumulatorLease::operator->() const {
+    return accumulator_.get();
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+// Relevance accumulator indexed by dense internal document ids; takes 12 bytes per
+// document of the largest range it was reset for.
+// Every Reset starts a new generation instead of clearing the arrays:
+// a score counts only if its stamp equals the current generation,
+// and the stamp generation + 1 marks a document excluded from the query.
+class ScoreAccumulator {
+public:
+    void Reset(size_t document_count);
+
+    // Returns true if the document got its first score in this generation.
+    // The caller is expected to skip excluded documents
+    bool Add(int document, double value) {
+        uint32_t& stamp = stamps_[document];
+        if (stamp == generation_) {
+            scores_[document] += value;
+            return false;
+        }
+        stamp = generation_;
+        scores_[document] = value;
+        return true;
+    }
+
+    void Exclude(int document) {
+        stamps_[document] = generation_ + 1;
+    }
+
+    bool IsExcluded(int document) const {
+        return stamps_[document] == generation_ + 1;
+    }
+
+    bool Contains(int document) const {
+        return stamps_[document] == generation_;
+    }
+
+    double GetScore(int document) const {
+        return scores_[document];
+    }
+
+private:
+    vector<double> scores_;
+    vector<uint32_t> stamps_;
+    uint32_t generation_ = 0;
+};
+
+// Accumulators of one server, so queries reuse memory instead of allocating. Every
+// running query or query part holds one; once released, up to max_idle_count are kept
+// for the next queries and the rest are freed. The pool, and so its memory of about
+// 12 bytes per document slot and kept accumulator, goes away with its server
+class ScoreAccumulatorPool {
+public:
+    // 0 keeps as many as the hardware runs threads
+    explicit ScoreAccumulatorPool(size_t max_idle_count = 0);
+
+    unique_ptr<ScoreAccumulator> Acquire();
+
+    void Release(unique_ptr<ScoreAccumulator> accumulator);
+
+    // Frees the accumulators no query holds
+    void Clear();
+
+    size_t GetIdleCount() const;
+
+private:
+    size_t max_idle_count_;
+    mutable mutex mutex_;
+    vector<unique_ptr<ScoreAccumulator>> idle_;
+};
+
+// Borrows an accumulator from the pool for the lifetime of the lease. A query started
+// on a thread that is already inside another one (a worker stealing a task while it
+// waits) gets its own accumulator.
+class ScoreAccumulatorLease {
+public:
+    explicit ScoreAccumulatorLease(ScoreAccumulatorPool& pool);
+
+    ~ScoreAccumulatorLease();
+
+    ScoreAccumulatorLease(const ScoreAccumulatorLease&) = delete;
+
+    ScoreAccumulatorLease& operator=(const ScoreAccumulatorLease&) = delete;
+
+    ScoreAccumulator& operator*() const;
+
+    ScoreAccumulator* operator->() const;
+
+private:
+    ScoreAccumulatorPool& pool_;
+    unique_ptr<ScoreAccumulator> accumulator_;
+};
\ No newline at end of file
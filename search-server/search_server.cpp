@@ -1,4 +1,5 @@
 #include "search_server.h"
+#include "snapshot.h"
 
 SearchServer::SearchServer()
 {
@@ -14,20 +15,278 @@ SearchServer::SearchServer(const string& stop_words_text)
 {
 }
 
+SearchServer::SearchServer(SnapshotTag, const string& path) {
+    SnapshotReader reader(path);
+    vector<string_view> stop_words(reader.Read<uint64_t>());
+    for (string_view& word : stop_words) {
+        word = reader.ReadString();
+    }
+    stop_words_ = StopWordSet(stop_words);
+
+    // Internal ids are kept as they were, so the postings load without remapping
+    const uint64_t slot_count = reader.Read<uint64_t>();
+    vector<DocumentData*> documents_by_slot;
+    for (uint64_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+        const int document_id = reader.Read<int32_t>();
+        const int rating = reader.Read<int32_t>();
+        const auto status = static_cast<DocumentStatus>(reader.Read<int32_t>());
+        const bool is_live = reader.Read<uint8_t>() != 0;
+        document_slots_.push_back({ document_id, rating, status });
+        DocumentData* document_data = nullptr;
+        document_slots_.back().is_removed = !is_live;
+        if (is_live) {
+            const auto [it, inserted] = documents_.emplace(document_id, DocumentData{ static_cast<int>(internal_id), {}, {} });
+            if (!inserted) {
+                throw runtime_error("Snapshot is corrupted"s);
+            }
+            document_data = &it->second;
+            document_ids_.insert(document_id);
+        }
+        documents_by_slot.push_back(document_data);
+    }
+    const int open_segment_first_id = reader.Read<int32_t>();
+    if (open_segment_first_id < 0 || static_cast<uint64_t>(open_segment_first_id) > slot_count) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    index_.SetTermFreqQuantization(reader.Read<uint8_t>() != 0);
+
+    struct TermOccurrence {
+        int internal_id;
+        int term_id;
+        double term_freq;
+    };
+
+    const uint64_t term_count = reader.Read<uint64_t>();
+    vector<size_t> slot_term_counts(slot_count);
+    vector<TermOccurrence> term_occurrences;
+    vector<int32_t> document_ids;
+    vector<double> term_freqs;
+    vector<Posting> postings;
+    // Postings of the open segment are added once the rest is sealed
+    vector<pair<string_view, vector<Posting>>> open_postings;
+    const auto add_postings = [&](const string_view& word, const vector<Posting>& word_postings) {
+        const int term_id = index_.AddPostings(word, word_postings);
+        for (const Posting& posting : word_postings) {
+            ++slot_term_counts[posting.document_id];
+            term_occurrences.push_back({ posting.document_id, term_id, posting.term_freq });
+        }
+    };
+    for (uint64_t i = 0; i < term_count; ++i) {
+        const string_view word = reader.ReadString();
+        const uint64_t posting_count = reader.Read<uint64_t>();
+        document_ids.resize(posting_count);
+        term_freqs.resize(posting_count);
+        reader.ReadArray(document_ids.data(), posting_count);
+        reader.ReadArray(term_freqs.data(), posting_count);
+        postings.clear();
+        for (uint64_t j = 0; j < posting_count; ++j) {
+            const int internal_id = document_ids[j];
+            if (internal_id < 0 || static_cast<uint64_t>(internal_id) >= slot_count || documents_by_slot[internal_id] == nullptr
+                || (j > 0 && internal_id <= document_ids[j - 1])) {
+                throw runtime_error("Snapshot is corrupted"s);
+            }
+            postings.push_back({ internal_id, term_freqs[j] });
+        }
+        const auto open_first = lower_bound(postings.begin(), postings.end(), open_segment_first_id,
+            [](const Posting& posting, int document_id) { return posting.document_id < document_id; });
+        if (open_first != postings.end()) {
+            open_postings.emplace_back(word, vector<Posting>(open_first, postings.end()));
+            postings.erase(open_first, postings.end());
+        }
+        if (!postings.empty()) {
+            add_postings(word, postings);
+        }
+    }
+    if (!reader.IsEnd()) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    index_.MergeSegments(open_segment_first_id);
+    // Documents of the open segment hold no sealed postings, so their terms still come in word order
+    for (const auto& [word, word_postings] : open_postings) {
+        add_postings(word, word_postings);
+    }
+
+    // Terms are gathered per document and then sorted by id into its forward index
+    vector<size_t> slot_offsets(slot_count + 1);
+    for (uint64_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+        slot_offsets[internal_id + 1] = slot_offsets[internal_id] + slot_term_counts[internal_id];
+    }
+    vector<pair<int, double>> slot_terms(term_occurrences.size());
+    for (const auto& [internal_id, term_id, term_freq] : term_occurrences) {
+        slot_terms[slot_offsets[internal_id]++] = { term_id, term_freq };
+    }
+    // After the scatter every offset points at the end of its own slot
+    vector<pair<int, double>> terms;
+    for (uint64_t internal_id = 0; internal_id < slot_count; ++internal_id) {
+        if (documents_by_slot[internal_id] == nullptr) {
+            continue;
+        }
+        const size_t first = internal_id == 0 ? 0 : slot_offsets[internal_id - 1];
+        terms.assign(slot_terms.begin() + first, slot_terms.begin() + slot_offsets[internal_id]);
+        *documents_by_slot[internal_id] = MakeDocumentData(static_cast<int>(internal_id), terms);
+    }
+}
+
+SearchServer SearchServer::LoadSnapshot(const string& path) {
+    return SearchServer(SnapshotTag{}, path);
+}
+
+void SearchServer::SaveSnapshot(const string& path) const {
+    SnapshotWriter writer(path);
+    writer.Write(static_cast<uint64_t>(stop_words_.size()));
+    for (const string& word : stop_words_) {
+        writer.WriteString(word);
+    }
+
+    writer.Write(static_cast<uint64_t>(document_slots_.size()));
+    for (size_t internal_id = 0; internal_id < document_slots_.size(); ++internal_id) {
+        const DocumentSlot& slot = document_slots_[internal_id];
+        writer.Write(static_cast<int32_t>(slot.id));
+        writer.Write(static_cast<int32_t>(slot.rating));
+        writer.Write(static_cast<int32_t>(slot.status));
+        writer.Write(static_cast<uint8_t>(!slot.is_removed));
+    }
+    // Quantized sealed segments hold rounded term frequencies and the open one exact ones;
+    // keeping the boundary and the setting makes a loaded server score exactly like the saved one
+    writer.Write(static_cast<int32_t>(index_.GetOpenSegmentFirstId()));
+    writer.Write(static_cast<uint8_t>(index_.IsTermFreqQuantized()));
+
+    // Postings are stored as two flat arrays per term: internal ids, then term frequencies
+    const TermDictionary& dictionary = index_.GetDictionary();
+    // Terms go in word order, so loading appends to the end of every word frequency map.
+    // Removed documents are left out, so terms held only by them are dropped
+    vector<int> term_ids;
+    for (int term_id = 0; term_id < static_cast<int>(dictionary.GetIdLimit()); ++term_id) {
+        if (dictionary.GetRefCount(term_id) > 0 && index_.GetDocumentFreq(term_id) > 0) {
+            term_ids.push_back(term_id);
+        }
+    }
+    sort(term_ids.begin(), term_ids.end(), [&dictionary](int lhs, int rhs) {
+        return dictionary.GetTerm(lhs) < dictionary.GetTerm(rhs);
+    });
+    writer.Write(static_cast<uint64_t>(term_ids.size()));
+    vector<int32_t> document_ids;
+    vector<double> term_freqs;
+    for (const int term_id : term_ids) {
+        document_ids.clear();
+        term_freqs.clear();
+        index_.ForEachPosting(term_id, [&](int internal_id, double term_freq) {
+            if (!document_slots_[internal_id].is_removed) {
+                document_ids.push_back(internal_id);
+                term_freqs.push_back(term_freq);
+            }
+        });
+        writer.WriteString(dictionary.GetTerm(term_id));
+        writer.Write(static_cast<uint64_t>(document_ids.size()));
+        writer.WriteArray(document_ids.data(), document_ids.size());
+        writer.WriteArray(term_freqs.data(), term_freqs.size());
+    }
+    writer.Finish();
+}
+
 void SearchServer::AddDocument(int document_id, const string_view& document, DocumentStatus status, const vector<int>& ratings) {
     if ((document_id < 0) || (documents_.count(document_id) > 0)) {
         throw invalid_argument("Invalid document_id"s);
     }
-    bufer.emplace_back(document);
-    const auto words = SplitIntoWordsNoStop(bufer.back());
-    const double inv_word_count = 1.0 / words.size();
-    map<string_view, double> fr;
-    for (const string_view& word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        fr[word] += inv_word_count;
+    const map<string_view, double> document_freqs = ComputeWordFrequencies(document);
+    const int internal_id = static_cast<int>(document_slots_.size());
+    // Only term ids are kept, so the document text itself is not
+    vector<pair<int, double>> terms;
+    terms.reserve(document_freqs.size());
+    for (const auto& [word, term_freq] : document_freqs) {
+        terms.push_back({ index_.AddPosting(word, internal_id, term_freq), term_freq });
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status, fr });
+    document_slots_.push_back({ document_id, ComputeAverageRating(ratings), status });
+    documents_.emplace(document_id, MakeDocumentData(internal_id, terms));
     document_ids_.insert(document_id);
+    index_.SealSegmentIfFull(static_cast<int>(document_slots_.size()));
+    generation_ = NextGeneration();
+}
+
+void SearchServer::AddPendingDocuments(const execution::sequenced_policy& policy, const vector<PendingDocument>& documents) {
+    AddPendingDocuments(policy, documents, 1);
+}
+
+void SearchServer::AddPendingDocuments(const execution::parallel_policy& policy, const vector<PendingDocument>& documents) {
+    AddPendingDocuments(policy, documents, max(1u, thread::hardware_concurrency()));
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::AddPendingDocuments(const ExecutionPolicy& policy, const vector<PendingDocument>& documents, size_t chunk_count) {
+    // Everything is checked before the server is touched. Errors are caught inside the
+    // algorithms, since an exception escaping a parallel algorithm terminates the program
+    vector<exception_ptr> errors(documents.size());
+    set<int> batch_ids;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_id = documents[i].id;
+        if ((document_id < 0) || (documents_.count(document_id) > 0) || !batch_ids.insert(document_id).second) {
+            errors[i] = make_exception_ptr(invalid_argument("Invalid document_id"s));
+        }
+    }
+
+    vector<size_t> positions(documents.size());
+    iota(positions.begin(), positions.end(), 0);
+    vector<map<string_view, double>> document_freqs(documents.size());
+    for_each(policy, positions.begin(), positions.end(),
+        [&](size_t i) {
+            if (errors[i]) {
+                return;
+            }
+            try {
+                document_freqs[i] = ComputeWordFrequencies(documents[i].text);
+            }
+            catch (...) {
+                errors[i] = current_exception();
+            }
+        });
+    for (const exception_ptr& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    // Every chunk of consecutive documents builds its own small index. Internal ids follow
+    // the batch order, so merging the chunks in order only appends postings
+    const int first_internal_id = static_cast<int>(document_slots_.size());
+    chunk_count = max<size_t>(1, min(chunk_count, documents.size()));
+    vector<size_t> chunks(chunk_count);
+    iota(chunks.begin(), chunks.end(), 0);
+    vector<map<string_view, vector<Posting>>> partial_indexes(chunk_count);
+    for_each(policy, chunks.begin(), chunks.end(),
+        [&](size_t chunk) {
+            const size_t first = documents.size() * chunk / chunk_count;
+            const size_t last = documents.size() * (chunk + 1) / chunk_count;
+            for (size_t i = first; i < last; ++i) {
+                for (const auto& [word, term_freq] : document_freqs[i]) {
+                    partial_indexes[chunk][word].push_back({ first_internal_id + static_cast<int>(i), term_freq });
+                }
+            }
+        });
+    for (const auto& partial_index : partial_indexes) {
+        for (const auto& [word, postings] : partial_index) {
+            index_.AddPostings(word, postings);
+        }
+    }
+
+    // Forward indexes of the documents, as AddDocument builds them
+    vector<DocumentData> document_data(documents.size());
+    for_each(policy, positions.begin(), positions.end(),
+        [&](size_t i) {
+            vector<pair<int, double>> terms;
+            terms.reserve(document_freqs[i].size());
+            for (const auto& [word, term_freq] : document_freqs[i]) {
+                terms.push_back({ index_.FindTerm(word), term_freq });
+            }
+            document_data[i] = MakeDocumentData(first_internal_id + static_cast<int>(i), terms);
+        });
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const PendingDocument& document = documents[i];
+        document_slots_.push_back({ document.id, ComputeAverageRating(*document.ratings), document.status });
+        documents_.emplace(document.id, move(document_data[i]));
+        document_ids_.insert(document.id);
+    }
+    index_.SealSegmentIfFull(static_cast<int>(document_slots_.size()));
+    generation_ = NextGeneration();
 }
 
 vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query, DocumentStatus status) const {
@@ -38,6 +297,98 @@ vector<Document> SearchServer::FindTopDocuments(const string_view& raw_query) co
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename Consumer>
+void SearchServer::RunQueryBatch(const vector<string>& raw_queries, DocumentStatus status, size_t max_count, Consumer consume) const {
+    // Parsed up front and in order, so the first invalid query is the one reported
+    vector<QueryTerms> batch_terms;
+    batch_terms.reserve(raw_queries.size());
+    for (const string& raw_query : raw_queries) {
+        batch_terms.push_back(ResolveQueryTerms(ParseQuery(raw_query, true)));
+    }
+    const auto document_predicate = [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; };
+    const BatchPostings postings(*this, batch_terms, document_predicate);
+
+    thread_pool_->ParallelFor(raw_queries.size(), [&](size_t query_index) {
+        ScoreAccumulatorLease accumulator(*accumulator_pool_);
+        vector<int> scored_documents;
+        ScoreDocumentRange(batch_terms[query_index], document_predicate, 0, static_cast<int>(document_slots_.size()), *accumulator, scored_documents, &postings);
+        consume(query_index, CollectTopDocuments(*accumulator, scored_documents, 0, max_count));
+    });
+}
+
+vector<vector<Document>> SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status, size_t max_count) const {
+    vector<vector<Document>> results(raw_queries.size());
+    RunQueryBatch(raw_queries, status, max_count, [&results](size_t query_index, TopDocuments top_documents) {
+        results[query_index] = top_documents.Extract();
+    });
+    return results;
+}
+
+void SearchServer::FindTopDocumentsBatch(const vector<string>& raw_queries, vector<Document>& documents, vector<size_t>& offsets, DocumentStatus status, size_t max_count) const {
+    // Every query writes to its own stretch of places, as many as it may find; the
+    // stretches are then moved together, front to back, so no document is copied twice
+    const size_t stretch = min(max_count, documents_.size());
+    documents.resize(raw_queries.size() * stretch);
+    vector<size_t> counts(raw_queries.size());
+    RunQueryBatch(raw_queries, status, max_count, [&](size_t query_index, TopDocuments top_documents) {
+        counts[query_index] = top_documents.ExtractTo(documents.data() + query_index * stretch);
+    });
+
+    offsets.assign(1, 0);
+    for (size_t query_index = 0; query_index < raw_queries.size(); ++query_index) {
+        const auto first = documents.begin() + query_index * stretch;
+        move(first, first + counts[query_index], documents.begin() + offsets.back());
+        offsets.push_back(offsets.back() + counts[query_index]);
+    }
+    documents.resize(offsets.back());
+}
+
+ThreadPool& SearchServer::GetThreadPool() const {
+    return *thread_pool_;
+}
+
+SearchServer::AdaptiveExecutionStats SearchServer::GetAdaptiveExecutionStats() const {
+    AdaptiveExecutionStats stats;
+    stats.sequential_searches = adaptive_counters_->sequential_searches;
+    stats.parallel_searches = adaptive_counters_->parallel_searches;
+    stats.parallel_search_parts = adaptive_counters_->parallel_search_parts;
+    stats.sequential_matches = adaptive_counters_->sequential_matches;
+    stats.parallel_matches = adaptive_counters_->parallel_matches;
+    return stats;
+}
+
+void SearchServer::ResetAdaptiveExecutionStats() {
+    adaptive_counters_->sequential_searches = 0;
+    adaptive_counters_->parallel_searches = 0;
+    adaptive_counters_->parallel_search_parts = 0;
+    adaptive_counters_->sequential_matches = 0;
+    adaptive_counters_->parallel_matches = 0;
+}
+
+const SearchServer::BatchPostings::SharedPostings* SearchServer::BatchPostings::Find(int term_id) const {
+    const auto it = shared_.find(term_id);
+    return it != shared_.end() ? &it->second : nullptr;
+}
+
+string SearchServer::NormalizeQuery(const string_view& raw_query) const {
+    const Query query = ParseQuery(raw_query, true);
+    string normalized;
+    for (const string_view& word : query.plus_words) {
+        if (!normalized.empty()) {
+            normalized += ' ';
+        }
+        normalized += word;
+    }
+    for (const string_view& word : query.minus_words) {
+        if (!normalized.empty()) {
+            normalized += ' ';
+        }
+        normalized += '-';
+        normalized += word;
+    }
+    return normalized;
+}
+
 int SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
@@ -50,24 +401,28 @@ set<int>::const_iterator SearchServer::end() const {
     return document_ids_.end();
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (documents_.count(document_id) > 0) {
-        return documents_.at(document_id).freqs;
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return {};
+    }
+    const DocumentData& document_data = it->second;
+    return WordFrequencies(index_.GetDictionary(), document_data.term_ids.data(), document_data.term_freqs.data(), document_data.term_ids.size());
+}
+
+vector<int> SearchServer::GetDocumentTermIds(int document_id) const {
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end()) {
+        return {};
     }
-    static const map<string_view, double> e_m;
-    return e_m;
+    return it->second.term_ids;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    for (const auto& [word, _] : documents_.at(document_id).freqs) {
-        auto& doc_freqs = word_to_document_freqs_[word];
-        doc_freqs.erase(document_id);
-        if (doc_freqs.empty()) {
-            word_to_document_freqs_.erase(word);
-        }
+    for (const int term_id : documents_.at(document_id).term_ids) {
+        index_.DecrementDocumentFreq(term_id);
     }
-    document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    RetireDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
@@ -75,48 +430,101 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int d
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    vector<const string_view*> words_to_erase(documents_.at(document_id).freqs.size());
-
-    transform(
-        execution::par,
-        documents_.at(document_id).freqs.begin(), documents_.at(document_id).freqs.end(),
-        words_to_erase.begin(),
-        [this, &document_id](const auto& word_freq) { return &word_freq.first; }
-    );
-
-    for_each(execution::par, words_to_erase.begin(), words_to_erase.end(),
-        [this, &document_id](const auto& word_freq) {
-            word_to_document_freqs_[*word_freq].erase(document_id);
+    const vector<int>& term_ids = documents_.at(document_id).term_ids;
+
+    // The terms of one document are distinct and every term keeps its own counter, so this does not race
+    for_each(execution::par, term_ids.begin(), term_ids.end(),
+        [this](int term_id) {
+            index_.DecrementDocumentFreq(term_id);
         });
 
+    RetireDocument(document_id);
+}
+
+void SearchServer::RetireDocument(int document_id) {
+    const auto it = documents_.find(document_id);
+    document_slots_[it->second.internal_id].is_removed = true;
+    removed_documents_.push_back(move(it->second));
+    documents_.erase(it);
     document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    generation_ = NextGeneration();
+    if (removed_documents_.size() >= MIN_AUTO_COMPACTION_DOCUMENTS && removed_documents_.size() * 4 >= documents_.size()) {
+        CompactRemovedDocuments();
+    }
 }
 
-tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view& raw_query, int document_id) const {
-    const auto query = ParseQuery(raw_query, true);
+size_t SearchServer::CompactRemovedDocuments(size_t max_document_count) {
+    return CompactDocuments(execution::seq, max_document_count);
+}
 
-    for (const string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return { {}, documents_.at(document_id).status };
-        }
+size_t SearchServer::CompactRemovedDocuments(const std::execution::parallel_policy& policy, size_t max_document_count) {
+    return CompactDocuments(policy, max_document_count);
+}
+
+uint64_t SearchServer::GetGeneration() const {
+    return generation_;
+}
+
+uint64_t SearchServer::NextGeneration() {
+    static atomic<uint64_t> next_generation{ 1 };
+    return next_generation.fetch_add(1, memory_order_relaxed);
+}
+
+size_t SearchServer::GetRemovedDocumentCount() const {
+    return removed_documents_.size();
+}
+
+void SearchServer::MergeIndexSegments() {
+    index_.MergeSegments(static_cast<int>(document_slots_.size()));
+    // Re-encoding may quantize term frequencies that were exact so far
+    if (index_.IsTermFreqQuantized()) {
+        generation_ = NextGeneration();
     }
+}
 
-    vector<string_view> matched_words;
+void SearchServer::SetTermFreqQuantization(bool enabled) {
+    index_.SetTermFreqQuantization(enabled);
+}
 
-    for (const string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+bool SearchServer::IsTermFreqQuantized() const {
+    return index_.IsTermFreqQuantized();
+}
+
+size_t SearchServer::GetIndexSegmentCount() const {
+    return index_.GetSegmentCount();
+}
+
+size_t SearchServer::GetPostingsMemoryUsage() const {
+    return index_.GetPostingsMemoryUsage();
+}
+
+template <typename ExecutionPolicy>
+size_t SearchServer::CompactDocuments(const ExecutionPolicy& policy, size_t max_document_count) {
+    const size_t document_count = min(max_document_count, removed_documents_.size());
+    const auto last = removed_documents_.begin() + document_count;
+    unordered_map<int, int> term_references;
+    for (auto it = removed_documents_.begin(); it != last; ++it) {
+        for (const int term_id : it->term_ids) {
+            ++term_references[term_id];
         }
     }
+    const vector<pair<int, int>> terms(term_references.begin(), term_references.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    // A term is swept clean of every tombstone at once, including documents left for a later batch
+    for_each(policy, terms.begin(), terms.end(),
+        [this](const pair<int, int>& term) {
+            index_.PurgePostings(term.first, [this](int internal_id) { return document_slots_[internal_id].is_removed; });
+        });
+    for (const auto& [term_id, references] : terms) {
+        index_.ReleaseTerm(term_id, references);
+    }
+    removed_documents_.erase(removed_documents_.begin(), last);
+    return document_count;
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view& raw_query, int document_id) const {
+    // Term ids get sorted, so the words need not be
+    return MatchResolvedDocument(ResolveMatchTerms(ParseQuery(raw_query, false)), document_id);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, const string_view& raw_query, int document_id) const {
@@ -124,56 +532,236 @@ tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const std
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const string_view& raw_query, int document_id) const {
-    const auto query = ParseQuery(raw_query, false);
+    // The merge is linear in the document length, which leaves nothing worth splitting
+    return MatchDocument(raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(retrieval::AdaptivePolicy, const string_view& raw_query, int document_id) const {
+    ++adaptive_counters_->sequential_matches;
+    return MatchDocument(raw_query, document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const PreparedQuery& query, int document_id) const {
+    MatchTerms resolved;
+    return MatchResolvedDocument(GetPreparedMatchTerms(query, resolved), document_id);
+}
+
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::sequenced_policy&, const PreparedQuery& query, int document_id) const {
+    return MatchDocument(query, document_id);
+}
 
-    vector<string_view> matched_words(query.plus_words.size());
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const execution::parallel_policy&, const PreparedQuery& query, int document_id) const {
+    return MatchDocument(query, document_id);
+}
 
-    if (std::any_of(execution::par, query.minus_words.begin(), query.minus_words.end(), [&](const string_view& word) {
-        return word_to_document_freqs_.at(word).count(document_id);
-        })) {
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(retrieval::AdaptivePolicy, const PreparedQuery& query, int document_id) const {
+    ++adaptive_counters_->sequential_matches;
+    return MatchDocument(query, document_id);
+}
 
-        return { {}, documents_.at(document_id).status };
+tuple<vector<string_view>, DocumentStatus> SearchServer::MatchResolvedDocument(const MatchTerms& terms, int document_id) const {
+    const DocumentData& document_data = documents_.at(document_id);
+    vector<string_view> matched_words(terms.plus.size());
+    matched_words.resize(MatchDocumentTerms(terms, document_data, matched_words.data()));
+    return { matched_words, document_slots_[document_data.internal_id].status };
+}
+
+template <typename ForEach>
+MatchedDocuments SearchServer::MatchDocumentBatch(const MatchTerms& terms, const vector<int>& document_ids, ForEach for_each) const {
+    vector<const DocumentData*> document_data(document_ids.size());
+    vector<DocumentStatus> statuses(document_ids.size());
+    // A document matches at most as many words as it or the query has; offsets[i] starts
+    // its stretch of the buffer for now
+    vector<size_t> offsets(document_ids.size() + 1, 0);
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        const auto it = documents_.find(document_ids[i]);
+        if (it == documents_.end()) {
+            throw out_of_range("Invalid document_id "s + to_string(document_ids[i]));
+        }
+        document_data[i] = &it->second;
+        statuses[i] = document_slots_[it->second.internal_id].status;
+        offsets[i + 1] = offsets[i] + min(terms.plus.size(), it->second.term_ids.size());
     }
 
+    vector<string_view> words(offsets.back());
+    vector<size_t> word_counts(document_ids.size());
+    for_each(document_ids.size(), [&](size_t i) {
+        word_counts[i] = MatchDocumentTerms(terms, *document_data[i], words.data() + offsets[i]);
+    });
+
+    // Every stretch moves down onto the end of the previous one
+    size_t size = 0;
+    for (size_t i = 0; i < document_ids.size(); ++i) {
+        copy(words.begin() + offsets[i], words.begin() + offsets[i] + word_counts[i], words.begin() + size);
+        offsets[i] = size;
+        size += word_counts[i];
+    }
+    offsets.back() = size;
+    words.resize(size);
+    return MatchedDocuments(move(words), move(offsets), move(statuses));
+}
 
-    auto last = copy_if(execution::par, query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&](const string_view& word) {
-        return word_to_document_freqs_.at(word).count(document_id);
-        });
+MatchedDocuments SearchServer::MatchDocuments(const string_view& raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(execution::seq, raw_query, document_ids);
+}
 
-    matched_words.erase(last, matched_words.end());
-    sort(execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(unique(matched_words.begin(), matched_words.end()), matched_words.end());
+MatchedDocuments SearchServer::MatchDocuments(const execution::sequenced_policy& policy, const string_view& raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(policy, Prepare(raw_query), document_ids);
+}
 
-    return { matched_words, documents_.at(document_id).status };
+MatchedDocuments SearchServer::MatchDocuments(const execution::parallel_policy& policy, const string_view& raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(policy, Prepare(raw_query), document_ids);
 }
 
-bool SearchServer::IsStopWord(const string_view& word) const {
-    return stop_words_.count(word) > 0;
+MatchedDocuments SearchServer::MatchDocuments(retrieval::AdaptivePolicy policy, const string_view& raw_query, const vector<int>& document_ids) const {
+    return MatchDocuments(policy, Prepare(raw_query), document_ids);
 }
 
-bool SearchServer::IsValidWord(const string_view& word) {
-    return none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-        });
+MatchedDocuments SearchServer::MatchDocuments(const PreparedQuery& query, const vector<int>& document_ids) const {
+    return MatchDocuments(execution::seq, query, document_ids);
 }
 
-vector<string_view> SearchServer::SplitIntoWordsNoStop(const string_view& text) const {
-    vector<string_view> words;
-    for (const string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw invalid_argument("Word "s + string(word) + " is invalid"s);
+MatchedDocuments SearchServer::MatchDocuments(const execution::sequenced_policy&, const PreparedQuery& query, const vector<int>& document_ids) const {
+    MatchTerms resolved;
+    return MatchDocumentBatch(GetPreparedMatchTerms(query, resolved), document_ids, [](size_t count, const auto& match) {
+        for (size_t i = 0; i < count; ++i) {
+            match(i);
         }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
+    });
+}
+
+MatchedDocuments SearchServer::MatchDocuments(const execution::parallel_policy&, const PreparedQuery& query, const vector<int>& document_ids) const {
+    MatchTerms resolved;
+    return MatchDocumentBatch(GetPreparedMatchTerms(query, resolved), document_ids, [this](size_t count, const auto& match) {
+        GetThreadPool().ParallelFor(count, match);
+    });
+}
+
+MatchedDocuments SearchServer::MatchDocuments(retrieval::AdaptivePolicy, const PreparedQuery& query, const vector<int>& document_ids) const {
+    if (document_ids.size() < MIN_PARALLEL_MATCH_DOCUMENTS || GetThreadPool().GetThreadCount() <= 1) {
+        ++adaptive_counters_->sequential_matches;
+        return MatchDocuments(execution::seq, query, document_ids);
+    }
+    ++adaptive_counters_->parallel_matches;
+    return MatchDocuments(execution::par, query, document_ids);
+}
+
+SearchServer::MatchTerms SearchServer::ResolveMatchTerms(const Query& query) const {
+    const auto resolve = [this](const vector<string_view>& words) {
+        vector<int> term_ids;
+        term_ids.reserve(words.size());
+        for (const string_view& word : words) {
+            const int term_id = index_.FindTerm(word);
+            if (term_id != InvertedIndex::NO_TERM) {
+                term_ids.push_back(term_id);
+            }
+        }
+        sort(term_ids.begin(), term_ids.end());
+        term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+        return term_ids;
+    };
+    MatchTerms terms{ resolve(query.plus_words), resolve(query.minus_words), {} };
+    terms.plus_word_order.resize(terms.plus.size());
+    iota(terms.plus_word_order.begin(), terms.plus_word_order.end(), 0);
+    sort(terms.plus_word_order.begin(), terms.plus_word_order.end(), [this, &terms](size_t lhs, size_t rhs) {
+        return index_.GetTerm(terms.plus[lhs]) < index_.GetTerm(terms.plus[rhs]);
+    });
+    return terms;
+}
+
+size_t SearchServer::MatchDocumentTerms(const MatchTerms& terms, const DocumentData& document_data, string_view* matched_words) const {
+    // Calls action(position) for every term of query_ids the document holds, until it returns false
+    const auto intersect = [&document_data](const vector<int>& query_ids, auto action) {
+        const vector<int>& document_ids = document_data.term_ids;
+        for (size_t i = 0, j = 0; i < query_ids.size() && j < document_ids.size();) {
+            if (query_ids[i] < document_ids[j]) {
+                ++i;
+            }
+            else if (document_ids[j] < query_ids[i]) {
+                // Long documents skip ahead instead of stepping through every term
+                j = lower_bound(document_ids.begin() + j, document_ids.end(), query_ids[i]) - document_ids.begin();
+            }
+            else {
+                if (!action(i)) {
+                    return;
+                }
+                ++i;
+                ++j;
+            }
+        }
+    };
+
+    bool has_minus_word = false;
+    intersect(terms.minus, [&has_minus_word](size_t) {
+        has_minus_word = true;
+        return false;
+    });
+    if (has_minus_word) {
+        return 0;
+    }
+    // Reused by every document the thread matches
+    thread_local vector<char> is_matched;
+    is_matched.assign(terms.plus.size(), 0);
+    intersect(terms.plus, [](size_t position) {
+        is_matched[position] = 1;
+        return true;
+    });
+    // Interned terms stay valid after the caller's query string is gone
+    size_t count = 0;
+    for (const size_t position : terms.plus_word_order) {
+        if (is_matched[position]) {
+            matched_words[count++] = index_.GetTerm(terms.plus[position]);
         }
     }
-    return words;
+    return count;
+}
+
+bool SearchServer::IsStopWord(const string_view& word) const {
+    return stop_words_.Contains(word);
+}
+
+bool SearchServer::IsValidWord(const string_view& word) {
+    return !ContainsControlChar(word);
+}
+
+void SearchServer::SplitIntoWordsNoStop(const string_view& text, vector<string_view>& words) const {
+    const size_t invalid_word = SplitIntoWords(text, words);
+    if (invalid_word < words.size()) {
+        throw invalid_argument("Word "s + string(words[invalid_word]) + " is invalid"s);
+    }
+    if (!stop_words_.empty()) {
+        words.erase(remove_if(words.begin(), words.end(), [this](const string_view& word) { return IsStopWord(word); }), words.end());
+    }
+}
+
+SearchServer::DocumentData SearchServer::MakeDocumentData(int internal_id, vector<pair<int, double>>& terms) {
+    sort(terms.begin(), terms.end());
+    DocumentData document_data{ internal_id, {}, {} };
+    document_data.term_ids.reserve(terms.size());
+    document_data.term_freqs.reserve(terms.size());
+    for (const auto& [term_id, term_freq] : terms) {
+        document_data.term_ids.push_back(term_id);
+        document_data.term_freqs.push_back(term_freq);
+    }
+    return document_data;
 }
 
 int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
     return std::accumulate(ratings.begin(), ratings.end(), 0) / static_cast<int>(ratings.size());
 }
 
+map<string_view, double> SearchServer::ComputeWordFrequencies(const string_view& document) const {
+    // Reused by every document the thread tokenizes, so tokenizing does not allocate
+    thread_local vector<string_view> words;
+    SplitIntoWordsNoStop(document, words);
+    const double inv_word_count = 1.0 / words.size();
+    map<string_view, double> document_freqs;
+    for (const string_view& word : words) {
+        document_freqs[word] += inv_word_count;
+    }
+    return document_freqs;
+}
+
 SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view& text) const {
     if (text.empty()) {
         throw invalid_argument("Query word is empty"s);
@@ -192,7 +780,9 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view& text) co
 
 SearchServer::Query SearchServer::ParseQuery(const string_view& text, bool is_sort) const {
     Query query;
-    for (const string_view& word : SplitIntoWords(text)) {
+    thread_local vector<string_view> words;
+    SplitIntoWords(text, words);
+    for (const string_view& word : words) {
         const auto query_word = ParseQueryWord(word);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
@@ -205,18 +795,128 @@ SearchServer::Query SearchServer::ParseQuery(const string_view& text, bool is_so
     }
 
     if (is_sort) {
-        sort(execution::par, query.plus_words.begin(), query.plus_words.end());
+        // A handful of words, not worth a parallel sort
+        sort(query.plus_words.begin(), query.plus_words.end());
         query.plus_words.erase(unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
 
-        sort(execution::par, query.minus_words.begin(), query.minus_words.end());
+        sort(query.minus_words.begin(), query.minus_words.end());
         query.minus_words.erase(unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
     }
 
     return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view& word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+TopDocuments SearchServer::CollectTopDocuments(const ScoreAccumulator& accumulator, const vector<int>& scored_documents, int first_id, size_t max_count) const {
+    TopDocuments top_documents(max_count);
+    for (const int slot_index : scored_documents) {
+        if (accumulator.Contains(slot_index)) {
+            const DocumentSlot& slot = document_slots_[first_id + slot_index];
+            top_documents.Add({ slot.id, accumulator.GetScore(slot_index), slot.rating });
+        }
+    }
+    return top_documents;
+}
+
+SearchServer::QueryTerms SearchServer::ResolveQueryTerms(const Query& query) const {
+    QueryTerms terms;
+    for (const string_view& word : query.plus_words) {
+        const int term_id = index_.FindTerm(word);
+        // A term left only in removed documents matches nothing
+        if (term_id != InvertedIndex::NO_TERM && index_.GetDocumentFreq(term_id) > 0) {
+            terms.plus.push_back({ term_id, ComputeWordInverseDocumentFreq(term_id) });
+            terms.plus_posting_count += index_.GetPostingCount(term_id);
+        }
+    }
+    for (const string_view& word : query.minus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id != InvertedIndex::NO_TERM && index_.GetDocumentFreq(term_id) > 0) {
+            terms.minus.push_back(term_id);
+            terms.minus_posting_count += index_.GetPostingCount(term_id);
+        }
+    }
+    return terms;
+}
+
+SearchServer::PreparedQuery SearchServer::Prepare(const string_view& raw_query) const {
+    const Query query = ParseQuery(raw_query, true);
+    PreparedQuery prepared;
+    prepared.plus_words_.assign(query.plus_words.begin(), query.plus_words.end());
+    prepared.minus_words_.assign(query.minus_words.begin(), query.minus_words.end());
+    Revalidate(prepared);
+    return prepared;
+}
+
+void SearchServer::Revalidate(PreparedQuery& query) const {
+    if (IsCurrent(query)) {
+        return;
+    }
+    const Query words = query.ToQuery();
+    query.terms_ = ResolveQueryTerms(words);
+    query.match_terms_ = ResolveMatchTerms(words);
+    query.search_server_ = this;
+    query.generation_ = generation_;
+}
+
+vector<Document> SearchServer::FindTopDocuments(const PreparedQuery& query, DocumentStatus status) const {
+    return FindTopDocuments(execution::seq, query, status);
+}
+
+bool SearchServer::IsCurrent(const PreparedQuery& query) const {
+    // Term ids are only handed out again once a document is added, which bumps the generation
+    return query.search_server_ == this && query.generation_ == generation_;
+}
+
+const SearchServer::QueryTerms& SearchServer::GetPreparedTerms(const PreparedQuery& query, QueryTerms& resolved) const {
+    if (IsCurrent(query)) {
+        return query.terms_;
+    }
+    resolved = ResolveQueryTerms(query.ToQuery());
+    return resolved;
+}
+
+const SearchServer::MatchTerms& SearchServer::GetPreparedMatchTerms(const PreparedQuery& query, MatchTerms& resolved) const {
+    if (IsCurrent(query)) {
+        return query.match_terms_;
+    }
+    resolved = ResolveMatchTerms(query.ToQuery());
+    return resolved;
+}
+
+const vector<string>& SearchServer::PreparedQuery::GetPlusWords() const {
+    return plus_words_;
+}
+
+const vector<string>& SearchServer::PreparedQuery::GetMinusWords() const {
+    return minus_words_;
+}
+
+SearchServer::Query SearchServer::PreparedQuery::ToQuery() const {
+    return { vector<string_view>(plus_words_.begin(), plus_words_.end()), vector<string_view>(minus_words_.begin(), minus_words_.end()) };
+}
+
+vector<int> SearchServer::SplitDocumentRange(const QueryTerms& terms) const {
+    // Several parts per thread, so threads that finish early pick up the rest
+    const size_t max_part_count = max<size_t>(1, thread::hardware_concurrency() * 4);
+    const size_t part_count = clamp<size_t>(terms.plus_posting_count / MIN_POSTINGS_PER_PART, 1, max_part_count);
+    vector<int> bounds(part_count + 1, 0);
+    bounds.back() = static_cast<int>(document_slots_.size());
+    if (part_count == 1) {
+        return bounds;
+    }
+
+    // The longest postings list dominates the work, so its quantiles balance the parts
+    const auto longest = max_element(terms.plus.begin(), terms.plus.end(), [this](const auto& lhs, const auto& rhs) {
+        return index_.GetPostingCount(lhs.first) < index_.GetPostingCount(rhs.first);
+    });
+    const size_t posting_count = index_.GetPostingCount(longest->first);
+    for (size_t part = 1; part < part_count; ++part) {
+        bounds[part] = max(bounds[part - 1], index_.GetPosting(longest->first, posting_count * part / part_count).document_id);
+    }
+    return bounds;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(int term_id) const {
+    return index_.GetInverseDocumentFreq(term_id, GetDocumentCount(), generation_);
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const string_view& query, DocumentStatus status, const vector<int>& ratings) {
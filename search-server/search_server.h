@@ -5,6 +5,7 @@
 #include <deque>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <stdexcept>
 #include <string>
@@ -16,22 +17,22 @@
 #include <type_traits>
 #include <mutex>
 #include <future>
+#include <thread>
+#include <limits>
+#include <atomic>
+#include <memory>
 
-#include "concurrent_map.h"
+#include "inverted_index.h"
+#include "score_accumulator.h"
 #include "string_processing.h"
+#include "stop_words.h"
 #include "read_input_functions.h"
 #include "document.h"
-
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
-
-const double EPSILON = 1e-6;
-
-enum class DocumentStatus {
-    ACTUAL,
-    IRRELEVANT,
-    BANNED,
-    REMOVED,
-};
+#include "matched_documents.h"
+#include "top_documents.h"
+#include "retrieval_policy.h"
+#include "thread_pool.h"
+#include "word_frequencies.h"
 
 class SearchServer {
 public:
@@ -46,19 +47,81 @@ public:
 
     void AddDocument(int document_id, const string_view& document, DocumentStatus status, const vector<int>& ratings);
 
+    // Elements unpack as [document_id, document, status, ratings]. Throws the same errors as AddDocument,
+    // the one of the earliest bad document, and adds nothing in that case
+    template <typename ExecutionPolicy, typename DocumentRange>
+    void AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents);
+
+    template <typename DocumentRange>
+    void AddDocuments(const DocumentRange& documents);
+
     vector<Document> FindTopDocuments(const string_view& raw_query, DocumentStatus status) const;
 
     vector<Document> FindTopDocuments(const string_view& raw_query) const;
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentPredicate document_predicate) const;
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
-    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentStatus status) const;
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentStatus status, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
     vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query) const;
 
+    // A query parsed once, with its terms and their IDFs looked up, see Prepare
+    class PreparedQuery;
+
+    // Throws invalid_argument on an invalid query, like FindTopDocuments. The result stays
+    // usable after documents are added or removed, or with another server: its terms are then
+    // looked up again on every use, until Revalidate refreshes them
+    PreparedQuery Prepare(const string_view& raw_query) const;
+
+    // Looks the terms up again unless they are current for this server
+    void Revalidate(PreparedQuery& query) const;
+
+    vector<Document> FindTopDocuments(const PreparedQuery& query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <typename ExecutionPolicy>
+    vector<Document> FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query) const;
+
+    // Canonical text of a query: its sorted unique plus words, then its sorted unique minus
+    // words with their minus signs, stop words left out. Queries of the same form find the
+    // same documents. Throws invalid_argument on an invalid query, like FindTopDocuments
+    string NormalizeQuery(const string_view& raw_query) const;
+
+    // Answers every query like FindTopDocuments(execution::seq, raw_query, status, max_count),
+    // spread over the thread pool. Postings lists needed by several queries of the batch are
+    // decoded once and shared. Throws the error of the first invalid query
+    vector<vector<Document>> FindTopDocumentsBatch(const vector<string>& raw_queries, DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // The same, written into one buffer: the documents of query i take places
+    // [offsets[i], offsets[i + 1]) of documents. Both vectors keep their capacity
+    void FindTopDocumentsBatch(const vector<string>& raw_queries, vector<Document>& documents, vector<size_t>& offsets, DocumentStatus status = DocumentStatus::ACTUAL, size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Runs the batches; it starts with one thread per hardware thread, see ThreadPool::Configure
+    ThreadPool& GetThreadPool() const;
+
+    // What retrieval::adaptive chose so far, to tune MIN_POSTINGS_PER_PART and
+    // MIN_PARALLEL_MATCH_DOCUMENTS against
+    struct AdaptiveExecutionStats {
+        uint64_t sequential_searches = 0;
+        uint64_t parallel_searches = 0;
+        // Parts the parallel searches were split into, summed up
+        uint64_t parallel_search_parts = 0;
+        // MatchDocument counts as a sequential match
+        uint64_t sequential_matches = 0;
+        uint64_t parallel_matches = 0;
+    };
+
+    AdaptiveExecutionStats GetAdaptiveExecutionStats() const;
+
+    void ResetAdaptiveExecutionStats();
 
     int GetDocumentCount() const;
 
@@ -66,7 +129,12 @@ public:
 
     set<int>::const_iterator end() const;
 
-    const map<string_view, double>& GetWordFrequencies(int document_id) const;
+    // Empty for an unknown document; see WordFrequencies for how long the view stays valid
+    WordFrequencies GetWordFrequencies(int document_id) const;
+
+    // Index term ids of the words of a document, ascending; empty for an unknown document.
+    // An id stays the same for as long as some document holds the term
+    vector<int> GetDocumentTermIds(int document_id) const;
 
     void RemoveDocument(int document_id);
 
@@ -74,37 +142,183 @@ public:
 
     void RemoveDocument(const std::execution::parallel_policy&, int document_id);
 
+    // Removal only marks the document; this erases the postings of up to max_document_count
+    // removed documents, oldest first, and returns how many were compacted.
+    // RemoveDocument runs it by itself once removed documents pile up
+    size_t CompactRemovedDocuments(size_t max_document_count = numeric_limits<size_t>::max());
+
+    size_t CompactRemovedDocuments(const std::execution::parallel_policy& policy, size_t max_document_count = numeric_limits<size_t>::max());
+
+    // Removed documents whose postings are still in the index
+    size_t GetRemovedDocumentCount() const;
+
+    // Changes whenever a document is added or removed, i.e. whenever query results may change.
+    // Values come from one counter for the whole process, so no other server, loaded
+    // snapshot included, ever has the same one
+    uint64_t GetGeneration() const;
+
+    // The index merges its segments as it grows; this merges all of them into one,
+    // e.g. from a maintenance task once ingestion calms down
+    void MergeIndexSegments();
+
+    size_t GetIndexSegmentCount() const;
+
+    // Off by default. When on, sealed segments store term frequencies as 16-bit floats and
+    // their postings shrink by about three quarters, but a relevance read from them may be
+    // off by a relative 2^-12, far more than EPSILON: documents with equal texts on either
+    // side of a segment boundary are then ordered by that error rather than by rating.
+    // Applies to the segments sealed or merged after the call
+    void SetTermFreqQuantization(bool enabled);
+
+    bool IsTermFreqQuantized() const;
+
+    // Bytes taken by the postings lists; sealed segments keep them compressed
+    size_t GetPostingsMemoryUsage() const;
+
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const string_view& raw_query, int document_id) const;
 
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const string_view& raw_query, int document_id) const;
 
     tuple<vector<string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const string_view& raw_query, int document_id) const;
 
+    tuple<vector<string_view>, DocumentStatus> MatchDocument(retrieval::AdaptivePolicy, const string_view& raw_query, int document_id) const;
+
+    // Matches one query against every document of document_ids, in their order, parsing and
+    // looking the query up once. Throws out_of_range for an unknown id before matching anything
+    MatchedDocuments MatchDocuments(const string_view& raw_query, const vector<int>& document_ids) const;
+
+    MatchedDocuments MatchDocuments(const std::execution::sequenced_policy&, const string_view& raw_query, const vector<int>& document_ids) const;
+
+    // Spreads the documents over the thread pool
+    MatchedDocuments MatchDocuments(const std::execution::parallel_policy&, const string_view& raw_query, const vector<int>& document_ids) const;
+
+    // Goes to the thread pool for at least MIN_PARALLEL_MATCH_DOCUMENTS documents
+    MatchedDocuments MatchDocuments(retrieval::AdaptivePolicy, const string_view& raw_query, const vector<int>& document_ids) const;
+
+    tuple<vector<string_view>, DocumentStatus> MatchDocument(const PreparedQuery& query, int document_id) const;
+
+    tuple<vector<string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy&, const PreparedQuery& query, int document_id) const;
+
+    tuple<vector<string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, const PreparedQuery& query, int document_id) const;
+
+    tuple<vector<string_view>, DocumentStatus> MatchDocument(retrieval::AdaptivePolicy, const PreparedQuery& query, int document_id) const;
+
+    MatchedDocuments MatchDocuments(const PreparedQuery& query, const vector<int>& document_ids) const;
+
+    MatchedDocuments MatchDocuments(const std::execution::sequenced_policy&, const PreparedQuery& query, const vector<int>& document_ids) const;
+
+    MatchedDocuments MatchDocuments(const std::execution::parallel_policy&, const PreparedQuery& query, const vector<int>& document_ids) const;
+
+    MatchedDocuments MatchDocuments(retrieval::AdaptivePolicy, const PreparedQuery& query, const vector<int>& document_ids) const;
+
+    // Stores stop words, terms, postings and document metadata in a binary snapshot file
+    void SaveSnapshot(const string& path) const;
+
+    // Throws runtime_error if the file is missing, corrupted or of another format version
+    static SearchServer LoadSnapshot(const string& path);
+
 private:
+    struct SnapshotTag {};
+
+    SearchServer(SnapshotTag, const string& path);
+
+    // Forward index of a document: its term ids, ascending, and their frequencies
     struct DocumentData {
+        int internal_id;
+        vector<int> term_ids;
+        vector<double> term_freqs;
+    };
+
+    // The index refers to documents by dense internal ids handed out in insertion order,
+    // so postings are appended at the end and scores can live in flat arrays
+    struct DocumentSlot {
+        int id;
         int rating;
         DocumentStatus status;
-        map<string_view, double> freqs;
+        // Tombstone: the postings may still point here, but the document is gone
+        bool is_removed = false;
     };
 
-    deque<string> bufer;
+    struct PendingDocument {
+        int id;
+        string_view text;
+        DocumentStatus status;
+        const vector<int>* ratings;
+    };
+
+    // Below this many postings per part a parallel query is not worth splitting further;
+    // retrieval::adaptive stays sequential unless a query reads at least two parts' worth
+    static constexpr size_t MIN_POSTINGS_PER_PART = 8192;
+
+    // Fewer documents are matched by retrieval::adaptive on the calling thread
+    static constexpr size_t MIN_PARALLEL_MATCH_DOCUMENTS = 256;
 
-    set<string, less<>> stop_words_;
+    struct AdaptiveExecutionCounters {
+        atomic<uint64_t> sequential_searches{ 0 };
+        atomic<uint64_t> parallel_searches{ 0 };
+        atomic<uint64_t> parallel_search_parts{ 0 };
+        atomic<uint64_t> sequential_matches{ 0 };
+        atomic<uint64_t> parallel_matches{ 0 };
+    };
+
+    // Automatic compaction waits for this many removed documents, and for at least
+    // one removed document per four live ones
+    static constexpr size_t MIN_AUTO_COMPACTION_DOCUMENTS = 1024;
 
-    map<string_view, map<int, double>> word_to_document_freqs_;
+    StopWordSet stop_words_;
+
+    InvertedIndex index_;
 
     map<int, DocumentData> documents_;
 
+    vector<DocumentSlot> document_slots_;
+
     set<int> document_ids_;
 
+    // Removed documents waiting for compaction; they keep their references to the terms
+    vector<DocumentData> removed_documents_;
+
+    // Keys the cached IDF values of the index; never 0, see GenerationCachedValue
+    uint64_t generation_ = NextGeneration();
+
+    unique_ptr<ThreadPool> thread_pool_ = make_unique<ThreadPool>();
+
+    // Behind a pointer, like the pool, so that the server stays movable
+    unique_ptr<AdaptiveExecutionCounters> adaptive_counters_ = make_unique<AdaptiveExecutionCounters>();
+
+    // Owned by the server, so their memory goes with it
+    unique_ptr<ScoreAccumulatorPool> accumulator_pool_ = make_unique<ScoreAccumulatorPool>();
+
+    // Hands out process-wide unique generations, starting from 1
+    static uint64_t NextGeneration();
+
     bool IsStopWord(const string_view& word) const;
 
     static bool IsValidWord(const string_view& word);
 
-    vector<string_view> SplitIntoWordsNoStop(const string_view& text) const;
+    // Fills words with the words of text; throws invalid_argument on a control character
+    void SplitIntoWordsNoStop(const string_view& text, vector<string_view>& words) const;
 
     static int ComputeAverageRating(const vector<int>& ratings);
 
+    // Tombstones the document whose terms have already been accounted for
+    void RetireDocument(int document_id);
+
+    template <typename ExecutionPolicy>
+    size_t CompactDocuments(const ExecutionPolicy& policy, size_t max_document_count);
+
+    map<string_view, double> ComputeWordFrequencies(const string_view& document) const;
+
+    // Sorts the terms by id and splits them into the two arrays
+    static DocumentData MakeDocumentData(int internal_id, vector<pair<int, double>>& terms);
+
+    void AddPendingDocuments(const execution::sequenced_policy& policy, const vector<PendingDocument>& documents);
+
+    void AddPendingDocuments(const execution::parallel_policy& policy, const vector<PendingDocument>& documents);
+
+    template <typename ExecutionPolicy>
+    void AddPendingDocuments(const ExecutionPolicy& policy, const vector<PendingDocument>& documents, size_t chunk_count);
+
     struct QueryWord {
         string_view data;
         bool is_minus;
@@ -120,44 +334,188 @@ private:
 
     Query ParseQuery(const string_view& text, bool is_sort) const;
 
+    // Query terms for MatchDocument; unknown words are dropped
+    struct MatchTerms {
+        // Term ids, ascending
+        vector<int> plus;
+        vector<int> minus;
+        // Positions in plus, in the order of the words
+        vector<size_t> plus_word_order;
+    };
+
+    MatchTerms ResolveMatchTerms(const Query& query) const;
+
+    // Merges the term ids of the query with those of the document and writes the matched
+    // words, in word order, to matched_words, which has room for all of them. Returns their count
+    size_t MatchDocumentTerms(const MatchTerms& terms, const DocumentData& document_data, string_view* matched_words) const;
+
+    tuple<vector<string_view>, DocumentStatus> MatchResolvedDocument(const MatchTerms& terms, int document_id) const;
+
+    // for_each(count, match) calls match(i) for every i in [0, count)
+    template <typename ForEach>
+    MatchedDocuments MatchDocumentBatch(const MatchTerms& terms, const vector<int>& document_ids, ForEach for_each) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(execution::sequenced_policy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(execution::parallel_policy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    struct QueryTerms {
+        vector<pair<int, double>> plus;
+        vector<int> minus;
+        size_t plus_posting_count = 0;
+        size_t minus_posting_count = 0;
+    };
+
+    // Looks the query words up in the index; unknown words are dropped
+    QueryTerms ResolveQueryTerms(const Query& query) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(execution::sequenced_policy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(execution::parallel_policy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(retrieval::AdaptivePolicy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    // Sequential when the split gives a single part or there is a single hardware thread
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(retrieval::AdaptivePolicy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const;
+
+    // Scores the parts between consecutive bounds in parallel
+    template <typename DocumentPredicate>
+    vector<Document> FindDocumentsInParts(const QueryTerms& terms, const vector<int>& bounds, DocumentPredicate document_predicate, size_t max_count) const;
+
+    // True if the terms of the query were looked up by this server at its current generation
+    bool IsCurrent(const PreparedQuery& query) const;
+
+    // The terms of the query if they are current, otherwise resolved into the given scratch
+    const QueryTerms& GetPreparedTerms(const PreparedQuery& query, QueryTerms& resolved) const;
+
+    const MatchTerms& GetPreparedMatchTerms(const PreparedQuery& query, MatchTerms& resolved) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindPreparedDocuments(execution::sequenced_policy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindPreparedDocuments(execution::parallel_policy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const;
+
     template <typename DocumentPredicate>
-    vector<Document> FindAllDocuments(execution::sequenced_policy, const Query& query, DocumentPredicate document_predicate) const;
+    vector<Document> FindPreparedDocuments(retrieval::AdaptivePolicy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    // Top-K strategies look the words up themselves
+    template <typename RetrievalPolicy, typename DocumentPredicate>
+    vector<Document> FindPreparedDocuments(RetrievalPolicy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const;
 
+    // Postings of the terms that several queries of a batch share, read from the index once.
+    // A shared list keeps only the documents the batch may find, each with its
+    // term_freq * idf, so the queries skip the document checks for them
+    class BatchPostings {
+    public:
+        struct SharedPostings {
+            vector<int> document_ids;
+            vector<double> scores;
+
+            template <typename Action>
+            void ForEach(int first_document_id, int last_document_id, Action action) const;
+        };
+
+        template <typename DocumentPredicate>
+        BatchPostings(const SearchServer& search_server, const vector<QueryTerms>& batch_terms, DocumentPredicate document_predicate);
+
+        // nullptr unless the term is shared
+        const SharedPostings* Find(int term_id) const;
+
+    private:
+        unordered_map<int, SharedPostings> shared_;
+    };
+
+    // Scores the queries of a batch on the thread pool and passes the best documents of
+    // each to consume(query_index, TopDocuments)
+    template <typename Consumer>
+    void RunQueryBatch(const vector<string>& raw_queries, DocumentStatus status, size_t max_count, Consumer consume) const;
+
+    // A query of a batch reads the shared lists of batch_postings instead of the index
     template <typename DocumentPredicate>
-    vector<Document> FindAllDocuments(execution::parallel_policy, const Query& query, DocumentPredicate document_predicate) const;
+    void ScoreDocumentRange(const QueryTerms& terms, DocumentPredicate document_predicate, int first_id, int last_id, ScoreAccumulator& accumulator, vector<int>& scored_documents, const BatchPostings* batch_postings = nullptr) const;
 
-    double ComputeWordInverseDocumentFreq(const string_view& word) const;
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(retrieval::WandPolicy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindAllDocuments(retrieval::BlockMaxWandPolicy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const;
+
+    template <typename DocumentPredicate>
+    vector<Document> FindTopDocumentsWand(const Query& query, DocumentPredicate document_predicate, size_t max_count, bool use_block_max) const;
+
+    double ComputeWordInverseDocumentFreq(int term_id) const;
+
+    // Accumulator slots are internal ids shifted by first_id
+    TopDocuments CollectTopDocuments(const ScoreAccumulator& accumulator, const vector<int>& scored_documents, int first_id, size_t max_count) const;
+
+    // Splits internal ids into ranges holding similar shares of the query postings
+    vector<int> SplitDocumentRange(const QueryTerms& terms) const;
+};
+
+class SearchServer::PreparedQuery {
+public:
+    // Sorted and unique, stop words left out
+    const vector<string>& GetPlusWords() const;
+
+    const vector<string>& GetMinusWords() const;
+
+private:
+    friend class SearchServer;
+
+    vector<string> plus_words_;
+    vector<string> minus_words_;
+
+    // The server and generation the terms below were looked up at
+    const SearchServer* search_server_ = nullptr;
+    uint64_t generation_ = 0;
+
+    QueryTerms terms_;
+    MatchTerms match_terms_;
+
+    // Views of the words above
+    Query ToQuery() const;
 };
 
 template <typename StringContainer>
 SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words))  // Extract non-empty stop words
+    : stop_words_(stop_words)  // Extract non-empty stop words
 {
     if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
         throw invalid_argument("Some of stop words are invalid"s);
     }
 }
 
+template <typename ExecutionPolicy, typename DocumentRange>
+void SearchServer::AddDocuments(const ExecutionPolicy& policy, const DocumentRange& documents) {
+    vector<PendingDocument> pending;
+    for (const auto& [document_id, document, status, ratings] : documents) {
+        pending.push_back({ document_id, document, status, &ratings });
+    }
+    AddPendingDocuments(policy, pending);
+}
+
+template <typename DocumentRange>
+void SearchServer::AddDocuments(const DocumentRange& documents) {
+    AddDocuments(execution::seq, documents);
+}
+
 template <typename ExecutionPolicy, typename DocumentPredicate>
-vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentPredicate document_predicate) const {
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const string_view& raw_query, DocumentPredicate document_predicate, size_t max_count) const {
     const auto query = ParseQuery(raw_query, true);
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-
-    sort(matched_documents.begin(), matched_documents.end(),
-        [&](const Document& lhs, const Document& rhs) {
-            return lhs.relevance > rhs.relevance
-                || (abs(lhs.relevance - rhs.relevance) < EPSILON && lhs.rating > rhs.rating);
-        });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
+    return FindAllDocuments(policy, query, document_predicate, max_count);
 }
 
 template <typename ExecutionPolicy>
-vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy & policy, const string_view & raw_query, DocumentStatus status) const {
-    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; });
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy & policy, const string_view & raw_query, DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; }, max_count);
 }
 
 template <typename ExecutionPolicy>
@@ -165,77 +523,364 @@ vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, c
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename ExecutionPolicy, typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindPreparedDocuments(policy, query, document_predicate, max_count);
+}
+
+template <typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query, DocumentStatus status, size_t max_count) const {
+    return FindTopDocuments(policy, query, [status](int document_id, DocumentStatus document_status, int rating) { return document_status == status; }, max_count);
+}
+
+template <typename ExecutionPolicy>
+vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy& policy, const PreparedQuery& query) const {
+    return FindTopDocuments(policy, query, DocumentStatus::ACTUAL);
+}
+
 template <typename DocumentPredicate>
-vector<Document> SearchServer::FindAllDocuments(execution::sequenced_policy, const Query& query, DocumentPredicate document_predicate) const {
-    map<int, double> document_to_relevance;
-    for (const string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
-            }
-        }
+vector<Document> SearchServer::FindPreparedDocuments(execution::sequenced_policy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const {
+    QueryTerms resolved;
+    return FindAllDocuments(policy, GetPreparedTerms(query, resolved), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindPreparedDocuments(execution::parallel_policy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const {
+    QueryTerms resolved;
+    return FindAllDocuments(policy, GetPreparedTerms(query, resolved), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindPreparedDocuments(retrieval::AdaptivePolicy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const {
+    QueryTerms resolved;
+    return FindAllDocuments(policy, GetPreparedTerms(query, resolved), document_predicate, max_count);
+}
+
+template <typename RetrievalPolicy, typename DocumentPredicate>
+vector<Document> SearchServer::FindPreparedDocuments(RetrievalPolicy policy, const PreparedQuery& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindAllDocuments(policy, query.ToQuery(), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(execution::sequenced_policy policy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindAllDocuments(policy, ResolveQueryTerms(query), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindAllDocuments(policy, ResolveQueryTerms(query), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(execution::sequenced_policy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const {
+    ScoreAccumulatorLease accumulator(*accumulator_pool_);
+    vector<int> scored_documents;
+    ScoreDocumentRange(terms, document_predicate, 0, static_cast<int>(document_slots_.size()), *accumulator, scored_documents);
+    return CollectTopDocuments(*accumulator, scored_documents, 0, max_count).Extract();
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(execution::parallel_policy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindDocumentsInParts(terms, SplitDocumentRange(terms), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(retrieval::AdaptivePolicy policy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindAllDocuments(policy, ResolveQueryTerms(query), document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(retrieval::AdaptivePolicy, const QueryTerms& terms, DocumentPredicate document_predicate, size_t max_count) const {
+    const vector<int> bounds = SplitDocumentRange(terms);
+    const size_t part_count = bounds.size() - 1;
+    if (part_count == 1 || thread::hardware_concurrency() <= 1) {
+        ++adaptive_counters_->sequential_searches;
+        return FindAllDocuments(execution::seq, terms, document_predicate, max_count);
     }
-    for (const string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    ++adaptive_counters_->parallel_searches;
+    adaptive_counters_->parallel_search_parts += part_count;
+    return FindDocumentsInParts(terms, bounds, document_predicate, max_count);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindDocumentsInParts(const QueryTerms& terms, const vector<int>& bounds, DocumentPredicate document_predicate, size_t max_count) const {
+    // Every part scores its own range of internal ids into private state, so no locks are taken
+    const size_t part_count = bounds.size() - 1;
+    vector<TopDocuments> partial(part_count, TopDocuments(max_count));
+    vector<size_t> parts(part_count);
+    iota(parts.begin(), parts.end(), 0);
+    for_each(execution::par, parts.begin(), parts.end(),
+        [&](size_t part) {
+            ScoreAccumulatorLease accumulator(*accumulator_pool_);
+            vector<int> scored_documents;
+            ScoreDocumentRange(terms, document_predicate, bounds[part], bounds[part + 1], *accumulator, scored_documents);
+            partial[part] = CollectTopDocuments(*accumulator, scored_documents, bounds[part], max_count);
+        });
+
+    TopDocuments top_documents(max_count);
+    for (const TopDocuments& part_top : partial) {
+        top_documents.Merge(part_top);
+    }
+    return top_documents.Extract();
+}
+
+template <typename Action>
+void SearchServer::BatchPostings::SharedPostings::ForEach(int first_document_id, int last_document_id, Action action) const {
+    const size_t first = lower_bound(document_ids.begin(), document_ids.end(), first_document_id) - document_ids.begin();
+    const size_t last = lower_bound(document_ids.begin() + first, document_ids.end(), last_document_id) - document_ids.begin();
+    for (size_t i = first; i < last; ++i) {
+        action(document_ids[i], scores[i]);
+    }
+}
+
+template <typename DocumentPredicate>
+SearchServer::BatchPostings::BatchPostings(const SearchServer& search_server, const vector<QueryTerms>& batch_terms, DocumentPredicate document_predicate) {
+    unordered_map<int, int> query_counts;
+    vector<int> term_ids;
+    for (const QueryTerms& terms : batch_terms) {
+        // A term counts once per query, even if the query has it both ways
+        term_ids = terms.minus;
+        for (const auto& [term_id, inverse_document_freq] : terms.plus) {
+            term_ids.push_back(term_id);
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        sort(term_ids.begin(), term_ids.end());
+        term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
+        for (const int term_id : term_ids) {
+            ++query_counts[term_id];
         }
     }
 
-    vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating });
+    // Every shared term gets its entry first, so the lists can be filled in parallel
+    vector<pair<int, SharedPostings*>> shared_terms;
+    for (const auto& [term_id, query_count] : query_counts) {
+        if (query_count > 1) {
+            shared_terms.push_back({ term_id, &shared_[term_id] });
+        }
     }
-    return matched_documents;
+    search_server.thread_pool_->ParallelFor(shared_terms.size(), [&](size_t i) {
+        const auto [term_id, shared] = shared_terms[i];
+        // The same cached value the queries have resolved, so scores match exactly
+        const double inverse_document_freq = search_server.ComputeWordInverseDocumentFreq(term_id);
+        search_server.index_.ForEachPosting(term_id, [&, shared = shared](int internal_id, double term_freq) {
+            const DocumentSlot& slot = search_server.document_slots_[internal_id];
+            if (!slot.is_removed && document_predicate(slot.id, slot.status, slot.rating)) {
+                shared->document_ids.push_back(internal_id);
+                shared->scores.push_back(term_freq * inverse_document_freq);
+            }
+        });
+    });
 }
 
 template <typename DocumentPredicate>
-vector<Document> SearchServer::FindAllDocuments(execution::parallel_policy, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(query.plus_words.size());
+void SearchServer::ScoreDocumentRange(const QueryTerms& terms, DocumentPredicate document_predicate, int first_id, int last_id, ScoreAccumulator& accumulator, vector<int>& scored_documents, const BatchPostings* batch_postings) const {
+    accumulator.Reset(last_id - first_id);
 
-    for_each(execution::par, query.plus_words.begin(), query.plus_words.end(),
-        [&](const string_view& word) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                return;
-            }
+    const auto find_shared = [batch_postings](int term_id) {
+        return batch_postings ? batch_postings->Find(term_id) : nullptr;
+    };
 
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+    const auto score_posting = [&](int internal_id, double term_freq, double inverse_document_freq) {
+        const int slot_index = internal_id - first_id;
+        if (accumulator.IsExcluded(slot_index)) {
+            return;
+        }
+        const DocumentSlot& slot = document_slots_[internal_id];
+        if (!slot.is_removed
+            && document_predicate(slot.id, slot.status, slot.rating)
+            && accumulator.Add(slot_index, term_freq * inverse_document_freq)) {
+            scored_documents.push_back(slot_index);
+        }
+    };
 
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    ConcurrentMap<int, double>::Access access = document_to_relevance[document_id];
-                    access.ref_to_value += term_freq * inverse_document_freq;
+    // Scores the postings of a plus term; inspect(slot_index) sees each of them first
+    const auto score_term = [&](int term_id, double inverse_document_freq, auto inspect) {
+        if (const BatchPostings::SharedPostings* shared = find_shared(term_id)) {
+            shared->ForEach(first_id, last_id, [&](int internal_id, double score) {
+                const int slot_index = internal_id - first_id;
+                inspect(slot_index);
+                if (!accumulator.IsExcluded(slot_index) && accumulator.Add(slot_index, score)) {
+                    scored_documents.push_back(slot_index);
+                }
+            });
+            return;
+        }
+        index_.ForEachPosting(term_id, first_id, last_id, [&](int internal_id, double term_freq) {
+            inspect(internal_id - first_id);
+            score_posting(internal_id, term_freq, inverse_document_freq);
+        });
+    };
+
+    // Minus words are resolved before scoring, so excluded documents are never scored
+    if (terms.minus_posting_count <= terms.plus_posting_count) {
+        const auto exclude = [&](int internal_id, double) {
+            accumulator.Exclude(internal_id - first_id);
+        };
+        for (const int term_id : terms.minus) {
+            // A shared list lacks documents the query cannot find anyway
+            if (const BatchPostings::SharedPostings* shared = find_shared(term_id)) {
+                shared->ForEach(first_id, last_id, exclude);
+            }
+            else {
+                index_.ForEachPosting(term_id, first_id, last_id, exclude);
+            }
+        }
+        for (const auto& [term_id, inverse_document_freq] : terms.plus) {
+            score_term(term_id, inverse_document_freq, [](int) {});
+        }
+        return;
+    }
+
+    // Minus lists outweigh the plus lists: look every new candidate up in them instead of walking them
+    for (const auto& [term_id, inverse_document_freq] : terms.plus) {
+        vector<PostingsCursor> minus_cursors;
+        for (const int minus_term_id : terms.minus) {
+            minus_cursors.push_back(index_.GetCursor(minus_term_id));
+        }
+        score_term(term_id, inverse_document_freq, [&](int slot_index) {
+            if (!accumulator.Contains(slot_index) && !accumulator.IsExcluded(slot_index)) {
+                const int internal_id = slot_index + first_id;
+                for (PostingsCursor& cursor : minus_cursors) {
+                    cursor.SkipTo(internal_id);
+                    if (!cursor.IsEnd() && cursor.GetDocumentId() == internal_id) {
+                        accumulator.Exclude(slot_index);
+                        break;
+                    }
                 }
             }
         });
+    }
+}
 
-    for (const auto& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(retrieval::WandPolicy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindTopDocumentsWand(query, document_predicate, max_count, false);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindAllDocuments(retrieval::BlockMaxWandPolicy, const Query& query, DocumentPredicate document_predicate, size_t max_count) const {
+    return FindTopDocumentsWand(query, document_predicate, max_count, true);
+}
+
+template <typename DocumentPredicate>
+vector<Document> SearchServer::FindTopDocumentsWand(const Query& query, DocumentPredicate document_predicate, size_t max_count, bool use_block_max) const {
+    struct TermCursor {
+        PostingsCursor cursor;
+        double inverse_document_freq;
+        double upper_bound;
+    };
+
+    // Kept in query word order, so relevance is summed exactly like in exhaustive scoring
+    vector<TermCursor> terms;
+    for (const string_view& word : query.plus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id == InvertedIndex::NO_TERM || index_.GetDocumentFreq(term_id) == 0) {
             continue;
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            ConcurrentMap<int, double>::Access access = document_to_relevance[document_id];
-            access.ref_to_value = 0;
+        const double inverse_document_freq = ComputeWordInverseDocumentFreq(term_id);
+        terms.push_back({ index_.GetCursor(term_id), inverse_document_freq, index_.GetMaxTermFreq(term_id) * inverse_document_freq });
+    }
+    vector<PostingsCursor> minus_cursors;
+    for (const string_view& word : query.minus_words) {
+        const int term_id = index_.FindTerm(word);
+        if (term_id != InvertedIndex::NO_TERM && index_.GetDocumentFreq(term_id) > 0) {
+            minus_cursors.push_back(index_.GetCursor(term_id));
         }
     }
 
-    std::map<int, double> result_map = document_to_relevance.BuildOrdinaryMap();
+    const auto is_excluded = [&minus_cursors](int document_id) {
+        for (PostingsCursor& cursor : minus_cursors) {
+            cursor.SkipTo(document_id);
+            if (!cursor.IsEnd() && cursor.GetDocumentId() == document_id) {
+                return true;
+            }
+        }
+        return false;
+    };
 
-    vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : result_map) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+    vector<TermCursor*> active;
+    for (TermCursor& term : terms) {
+        if (!term.cursor.IsEnd()) {
+            active.push_back(&term);
+        }
     }
 
-    return matched_documents;
+    TopDocuments top_documents(max_count);
+    while (max_count > 0 && !active.empty()) {
+        sort(active.begin(), active.end(), [](const TermCursor* lhs, const TermCursor* rhs) {
+            return lhs->cursor.GetDocumentId() < rhs->cursor.GetDocumentId();
+        });
+
+        // A document scoring within EPSILON of the worst kept one may still win on rating
+        const double threshold = top_documents.IsFull()
+            ? top_documents.GetWorst().relevance - EPSILON
+            : -numeric_limits<double>::infinity();
+
+        size_t pivot = 0;
+        double upper_bound = 0.0;
+        for (; pivot < active.size(); ++pivot) {
+            upper_bound += active[pivot]->upper_bound;
+            if (upper_bound >= threshold) {
+                break;
+            }
+        }
+        if (pivot == active.size()) {
+            break;
+        }
+        const int pivot_document_id = active[pivot]->cursor.GetDocumentId();
+        size_t last = pivot;
+        while (last + 1 < active.size() && active[last + 1]->cursor.GetDocumentId() == pivot_document_id) {
+            ++last;
+        }
+
+        if (use_block_max) {
+            double block_upper_bound = 0.0;
+            for (size_t i = 0; i <= last; ++i) {
+                block_upper_bound += active[i]->cursor.GetBlockMaxTermFreq(pivot_document_id) * active[i]->inverse_document_freq;
+            }
+            if (block_upper_bound < threshold) {
+                // No document before the end of the current blocks can make it either
+                long long next_document_id = last + 1 < active.size()
+                    ? active[last + 1]->cursor.GetDocumentId()
+                    : numeric_limits<long long>::max();
+                for (size_t i = 0; i <= last; ++i) {
+                    next_document_id = min(next_document_id, active[i]->cursor.GetBlockLastDocumentId() + 1LL);
+                }
+                if (next_document_id > numeric_limits<int>::max()) {
+                    break;
+                }
+                for (size_t i = 0; i <= last; ++i) {
+                    active[i]->cursor.SkipTo(static_cast<int>(next_document_id));
+                }
+                active.erase(remove_if(active.begin(), active.end(), [](const TermCursor* term) { return term->cursor.IsEnd(); }), active.end());
+                continue;
+            }
+        }
+
+        if (active[0]->cursor.GetDocumentId() == pivot_document_id) {
+            const DocumentSlot& slot = document_slots_[pivot_document_id];
+            if (!slot.is_removed
+                && !is_excluded(pivot_document_id)
+                && document_predicate(slot.id, slot.status, slot.rating)) {
+                double relevance = 0.0;
+                for (const TermCursor& term : terms) {
+                    if (!term.cursor.IsEnd() && term.cursor.GetDocumentId() == pivot_document_id) {
+                        relevance += term.cursor.GetTermFreq() * term.inverse_document_freq;
+                    }
+                }
+                top_documents.Add({ slot.id, relevance, slot.rating });
+            }
+            for (size_t i = 0; i <= last; ++i) {
+                active[i]->cursor.Next();
+            }
+        }
+        else {
+            for (size_t i = 0; i < pivot; ++i) {
+                active[i]->cursor.SkipTo(pivot_document_id);
+            }
+        }
+        active.erase(remove_if(active.begin(), active.end(), [](const TermCursor* term) { return term->cursor.IsEnd(); }), active.end());
+    }
+    return top_documents.Extract();
 }
 
 void AddDocument(SearchServer& search_server, int document_id, const string_view& query, DocumentStatus status, const vector<int>& ratings);
\ No newline at end of file
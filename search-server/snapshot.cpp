@@ -0,0 +1,142 @@
+#include "snapshot.h"
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+}
+
+void SnapshotChecksum::Update(const char* data, size_t size) {
+    uint64_t hash = hash_;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+    }
+    hash_ = hash;
+}
+
+uint64_t SnapshotChecksum::Get() const {
+    return hash_;
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , output_(temporary_path_, ios::binary | ios::trunc) {
+    if (!output_) {
+        throw runtime_error("Cannot open snapshot file "s + path);
+    }
+    // Written again by Finish, once the payload size and checksum are known
+    const SnapshotHeader header = {};
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!is_finished_) {
+        output_.close();
+        error_code error;
+        filesystem::remove(temporary_path_, error);
+    }
+}
+
+void SnapshotWriter::WriteString(const string_view& text) {
+    Write(static_cast<uint32_t>(text.size()));
+    WriteBytes(text.data(), text.size());
+}
+
+void SnapshotWriter::Finish() {
+    Flush();
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order_mark = BYTE_ORDER_MARK;
+    header.payload_size = payload_size_;
+    header.checksum = checksum_.Get();
+    output_.seekp(0);
+    output_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output_.close();
+    if (!output_) {
+        throw runtime_error("Cannot write snapshot file "s + path_);
+    }
+    error_code error;
+    filesystem::rename(temporary_path_, path_, error);
+    if (error) {
+        throw runtime_error("Cannot replace snapshot file "s + path_ + ": "s + error.message());
+    }
+    is_finished_ = true;
+}
+
+void SnapshotWriter::WriteBytes(const char* data, size_t size) {
+    if (buffer_.size() + size > BUFFER_SIZE) {
+        Flush();
+    }
+    if (size > BUFFER_SIZE) {
+        checksum_.Update(data, size);
+        output_.write(data, size);
+        payload_size_ += size;
+        return;
+    }
+    buffer_.insert(buffer_.end(), data, data + size);
+}
+
+void SnapshotWriter::Flush() {
+    checksum_.Update(buffer_.data(), buffer_.size());
+    output_.write(buffer_.data(), buffer_.size());
+    payload_size_ += buffer_.size();
+    buffer_.clear();
+}
+
+SnapshotReader::SnapshotReader(const string& path)
+    : file_(path) {
+    const char* file_data = file_.GetData().data();
+    const size_t file_size = file_.GetData().size();
+    SnapshotHeader header;
+    if (file_size < sizeof(header)) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    memcpy(&header, file_data, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.byte_order_mark != BYTE_ORDER_MARK) {
+        throw runtime_error("Not a snapshot file: "s + path);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw runtime_error("Unsupported snapshot version "s + to_string(header.version));
+    }
+    if (header.payload_size != file_size - sizeof(header)) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    data_ = file_data + sizeof(header);
+    size_ = header.payload_size;
+    SnapshotChecksum checksum;
+    checksum.Update(data_, size_);
+    if (checksum.Get() != header.checksum) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+}
+
+string_view SnapshotReader::ReadString() {
+    const uint32_t size = Read<uint32_t>();
+    return string_view(Take(size), size);
+}
+
+bool SnapshotReader::IsEnd() const {
+    return position_ == size_;
+}
+
+const char* SnapshotReader::Take(size_t size) {
+    if (size > size_ - position_) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    const char* data = data_ + position_;
+    position_ += size;
+    return data;
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+// Snapshot file: a fixed header (magic, version, byte order mark, payload size and
+// checksum) followed by the payload. Numbers are stored in host byte order, so files
+// written on a host with a different byte order are rejected instead of misread.
+const uint32_t SNAPSHOT_VERSION = 3;
+
+// FNV-1a over the payload bytes
+class SnapshotChecksum {
+public:
+    void Update(const char* data, size_t size);
+
+    uint64_t Get() const;
+
+private:
+    uint64_t hash_ = 14695981039346656037ULL;
+};
+
+// Writes to a temporary file next to path and renames it over path in Finish, so a
+// save that fails halfway leaves the previous snapshot as it was
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const string& path);
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    // Removes the temporary file unless Finish succeeded
+    ~SnapshotWriter();
+
+    template <typename T>
+    void Write(const T& value);
+
+    template <typename T>
+    void WriteArray(const T* values, size_t count);
+
+    void WriteString(const string_view& text);
+
+    // Flushes the payload, fills in the header and replaces the file at path
+    void Finish();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    string path_;
+    string temporary_path_;
+    ofstream output_;
+    bool is_finished_ = false;
+    vector<char> buffer_;
+    uint64_t payload_size_ = 0;
+    SnapshotChecksum checksum_;
+
+    void WriteBytes(const char* data, size_t size);
+
+    void Flush();
+};
+
+// Maps the whole file and checks the header and the checksum before anything is parsed
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const string& path);
+
+    template <typename T>
+    T Read();
+
+    template <typename T>
+    void ReadArray(T* values, size_t count);
+
+    // Points into the mapped file, valid while the reader lives
+    string_view ReadString();
+
+    bool IsEnd() const;
+
+private:
+    MappedFile file_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t position_ = 0;
+
+    const char* Take(size_t size);
+};
+
+template <typename T>
+void SnapshotWriter::Write(const T& value) {
+    static_assert(is_trivially_copyable_v<T>);
+    WriteBytes(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void SnapshotWriter::WriteArray(const T* values, size_t count) {
+    static_assert(is_trivially_copyable_v<T>);
+    WriteBytes(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+template <typename T>
+T SnapshotReader::Read() {
+    static_assert(is_trivially_copyable_v<T>);
+    T value;
+    memcpy(&value, Take(sizeof(T)), sizeof(T));
+    return value;
+}
+
+template <typename T>
+void SnapshotReader::ReadArray(T* values, size_t count) {
+    static_assert(is_trivially_copyable_v<T>);
+    if (count > size_ / sizeof(T)) {
+        throw runtime_error("Snapshot is corrupted"s);
+    }
+    const size_t size = count * sizeof(T);
+    const char* data = Take(size);
+    if (size > 0) {
+        memcpy(values, data, size);
+    }
+}
\ No newline at end of file
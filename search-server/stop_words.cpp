@@ -0,0 +1,15 @@
+#include "stop_words.h"
+
+void StopWordSet::BuildTable() {
+    slots_.assign(GetStopWordTableSize(words_.size()), Slot{});
+    const size_t mask = slots_.size() - 1;
+    for (size_t index = 0; index < words_.size(); ++index) {
+        const uint64_t hash = HashStopWord(words_[index]);
+        size_t i = hash & mask;
+        while (slots_[i].word_index != EMPTY_SLOT) {
+            i = (i + 1) & mask;
+        }
+        slots_[i] = { hash, static_cast<uint32_t>(index) };
+        AddToStopWordFilter(filter_, words_[index]);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,230 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "string_processing.h"
+
+using namespace std;
+
+// Stop words are looked up for every token of every document and query, so membership
+// is a hash table probe behind a prefilter instead of a tree search. The prefilter is a
+// 4096-bit map over the first byte, the last byte and the length of the words, so most
+// other tokens are rejected by one bit test before they are hashed.
+
+// FNV-1a, usable at compile time
+constexpr uint64_t HashStopWord(string_view word) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const size_t STOP_WORD_FILTER_WORDS = 64;
+
+constexpr size_t GetStopWordFilterBit(string_view word) {
+    if (word.empty()) {
+        return 0;
+    }
+    const size_t first = static_cast<unsigned char>(word.front());
+    const size_t last = static_cast<unsigned char>(word.back());
+    const size_t length = word.size() < 16 ? word.size() : 15;
+    return (first ^ (last << 4) ^ (length << 8)) % (STOP_WORD_FILTER_WORDS * 64);
+}
+
+constexpr bool TestStopWordFilter(const array<uint64_t, STOP_WORD_FILTER_WORDS>& filter, string_view word) {
+    const size_t bit = GetStopWordFilterBit(word);
+    return (filter[bit / 64] >> (bit % 64)) & 1;
+}
+
+constexpr void AddToStopWordFilter(array<uint64_t, STOP_WORD_FILTER_WORDS>& filter, string_view word) {
+    const size_t bit = GetStopWordFilterBit(word);
+    filter[bit / 64] |= uint64_t(1) << (bit % 64);
+}
+
+// Smallest power of two holding count words at a load factor of at most one half
+constexpr size_t GetStopWordTableSize(size_t count) {
+    size_t size = 1;
+    while (size < 2 * count) {
+        size *= 2;
+    }
+    return size;
+}
+
+// The same table for a fixed built-in list, filled at compile time:
+//     constexpr string_view WORDS[] = { "a"sv, "and"sv, "the"sv };
+//     constexpr FixedStopWordSet STOP_WORDS(WORDS);
+//     static_assert(STOP_WORDS.Contains("the"sv));
+// Words must outlive the set, which string literals do. Like StopWordSet, it drops empty
+// words and duplicates and iterates in sorted order, so a StopWordSet, e.g. the one of
+// a SearchServer given this set, takes the table over as it is instead of rehashing
+template <size_t N>
+class FixedStopWordSet {
+public:
+    constexpr explicit FixedStopWordSet(const string_view (&words)[N]) {
+        for (const string_view word : words) {
+            if (!word.empty() && !HasWord(word)) {
+                words_[size_++] = word;
+            }
+        }
+        // Insertion sort; the list is short and this runs at compile time
+        for (size_t i = 1; i < size_; ++i) {
+            const string_view word = words_[i];
+            size_t j = i;
+            for (; j > 0 && word < words_[j - 1]; --j) {
+                words_[j] = words_[j - 1];
+            }
+            words_[j] = word;
+        }
+        for (size_t index = 0; index < size_; ++index) {
+            Insert(index);
+        }
+    }
+
+    constexpr bool Contains(string_view word) const {
+        if (!TestStopWordFilter(filter_, word)) {
+            return false;
+        }
+        const uint64_t hash = HashStopWord(word);
+        for (size_t i = hash & (TABLE_SIZE - 1); word_indices_[i] != EMPTY_SLOT; i = (i + 1) & (TABLE_SIZE - 1)) {
+            if (hashes_[i] == hash && words_[word_indices_[i]] == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    constexpr size_t size() const {
+        return size_;
+    }
+
+    constexpr const string_view* begin() const {
+        return words_.data();
+    }
+
+    constexpr const string_view* end() const {
+        return words_.data() + size_;
+    }
+
+private:
+    friend class StopWordSet;
+
+    static constexpr size_t TABLE_SIZE = GetStopWordTableSize(N);
+    static constexpr size_t EMPTY_SLOT = N;
+
+    array<string_view, N> words_ = {};
+    array<uint64_t, TABLE_SIZE> hashes_ = {};
+    array<size_t, TABLE_SIZE> word_indices_ = MakeEmptyIndices();
+    size_t size_ = 0;
+    array<uint64_t, STOP_WORD_FILTER_WORDS> filter_ = {};
+
+    static constexpr array<size_t, TABLE_SIZE> MakeEmptyIndices() {
+        array<size_t, TABLE_SIZE> indices = {};
+        for (size_t& index : indices) {
+            index = EMPTY_SLOT;
+        }
+        return indices;
+    }
+
+    constexpr bool HasWord(string_view word) const {
+        for (size_t i = 0; i < size_; ++i) {
+            if (words_[i] == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    constexpr void Insert(size_t index) {
+        const uint64_t hash = HashStopWord(words_[index]);
+        size_t i = hash & (TABLE_SIZE - 1);
+        while (word_indices_[i] != EMPTY_SLOT) {
+            i = (i + 1) & (TABLE_SIZE - 1);
+        }
+        hashes_[i] = hash;
+        word_indices_[i] = index;
+        AddToStopWordFilter(filter_, words_[index]);
+    }
+};
+
+// Built once from a container of strings with the MakeUniqueNonEmptyStrings rules:
+// empty strings are dropped and duplicates kept once. Iterates the words in sorted order
+class StopWordSet {
+public:
+    StopWordSet() = default;
+
+    template <typename StringContainer>
+    explicit StopWordSet(const StringContainer& words);
+
+    // Copies the compile-time table; only the words themselves are copied into strings
+    template <size_t N>
+    explicit StopWordSet(const FixedStopWordSet<N>& words);
+
+    bool Contains(string_view word) const {
+        if (!TestStopWordFilter(filter_, word)) {
+            return false;
+        }
+        const uint64_t hash = HashStopWord(word);
+        const size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; slots_[i].word_index != EMPTY_SLOT; i = (i + 1) & mask) {
+            if (slots_[i].hash == hash && words_[slots_[i].word_index] == word) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const {
+        return words_.size();
+    }
+
+    bool empty() const {
+        return words_.empty();
+    }
+
+    vector<string>::const_iterator begin() const {
+        return words_.begin();
+    }
+
+    vector<string>::const_iterator end() const {
+        return words_.end();
+    }
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash = 0;
+        uint32_t word_index = EMPTY_SLOT;
+    };
+
+    vector<string> words_;
+    vector<Slot> slots_;
+    array<uint64_t, STOP_WORD_FILTER_WORDS> filter_ = {};
+
+    void BuildTable();
+};
+
+template <typename StringContainer>
+StopWordSet::StopWordSet(const StringContainer& words) {
+    const set<string, less<>> unique_words = MakeUniqueNonEmptyStrings(words);
+    words_.assign(unique_words.begin(), unique_words.end());
+    BuildTable();
+}
+
+template <size_t N>
+StopWordSet::StopWordSet(const FixedStopWordSet<N>& words)
+    : words_(words.begin(), words.end())
+    , slots_(FixedStopWordSet<N>::TABLE_SIZE)
+    , filter_(words.filter_) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        if (words.word_indices_[i] != FixedStopWordSet<N>::EMPTY_SLOT) {
+            slots_[i] = { words.hashes_[i], static_cast<uint32_t>(words.word_indices_[i]) };
+        }
+    }
+}
\ No newline at end of file
@@ -1,16 +1,126 @@
 #include "string_processing.h"
 
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool IsControlChar(char c) {
+    return c >= '\0' && c < ' ';
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+// Bit i of a mask stands for byte i of the chunk
+struct ChunkMasks {
+    uint32_t spaces;
+    uint32_t controls;
+};
+
+int CountTrailingZeros(uint32_t mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int count = 0;
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        ++count;
+    }
+    return count;
+#endif
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+const size_t CHUNK_SIZE = 32;
+
+ChunkMasks ScanChunk(const char* data) {
+    const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+    const __m256i spaces = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+    // Bytes compare as signed, so the ones from 0x80 up are not control characters
+    const __m256i controls = _mm256_and_si256(
+        _mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(-1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), bytes));
+    return { static_cast<uint32_t>(_mm256_movemask_epi8(spaces)), static_cast<uint32_t>(_mm256_movemask_epi8(controls)) };
+}
+
+#elif defined(__SSE2__)
+
+const size_t CHUNK_SIZE = 16;
+
+ChunkMasks ScanChunk(const char* data) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i spaces = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // Bytes compare as signed, so the ones from 0x80 up are not control characters
+    const __m128i controls = _mm_and_si128(
+        _mm_cmpgt_epi8(bytes, _mm_set1_epi8(-1)),
+        _mm_cmplt_epi8(bytes, _mm_set1_epi8(' ')));
+    return { static_cast<uint32_t>(_mm_movemask_epi8(spaces)), static_cast<uint32_t>(_mm_movemask_epi8(controls)) };
+}
+
+#endif
+
+}
+
 vector<string_view> SplitIntoWords(string_view text) {
     vector<string_view> words;
-    while (true) {
-        const auto space = text.find(' ');
-        words.push_back(text.substr(0, space));
-        if (space == text.npos) {
-            break;
+    SplitIntoWords(text, words);
+    return words;
+}
+
+size_t SplitIntoWords(string_view text, vector<string_view>& words) {
+    words.clear();
+    const char* data = text.data();
+    size_t word_start = 0;
+    size_t first_control = text.size();
+    size_t position = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; position + CHUNK_SIZE <= text.size(); position += CHUNK_SIZE) {
+        ChunkMasks masks = ScanChunk(data + position);
+        if (masks.controls != 0 && first_control == text.size()) {
+            first_control = position + CountTrailingZeros(masks.controls);
         }
-        else {
-            text.remove_prefix(space + 1);
+        for (; masks.spaces != 0; masks.spaces &= masks.spaces - 1) {
+            const size_t space = position + CountTrailingZeros(masks.spaces);
+            words.emplace_back(data + word_start, space - word_start);
+            word_start = space + 1;
         }
     }
-    return words;
+#endif
+    for (; position < text.size(); ++position) {
+        if (IsControlChar(data[position]) && first_control == text.size()) {
+            first_control = position;
+        }
+        if (data[position] == ' ') {
+            words.emplace_back(data + word_start, position - word_start);
+            word_start = position + 1;
+        }
+    }
+    words.emplace_back(data + word_start, text.size() - word_start);
+
+    if (first_control == text.size()) {
+        return words.size();
+    }
+    // The last word starting at or before the control character holds it
+    const auto after = upper_bound(words.begin(), words.end(), data + first_control,
+        [](const char* character, const string_view& word) { return character < word.data(); });
+    return (after - words.begin()) - 1;
+}
+
+bool ContainsControlChar(string_view text) {
+    size_t position = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; position + CHUNK_SIZE <= text.size(); position += CHUNK_SIZE) {
+        if (ScanChunk(text.data() + position).controls != 0) {
+            return true;
+        }
+    }
+#endif
+    return any_of(text.begin() + position, text.end(), IsControlChar);
 }
\ No newline at end of file
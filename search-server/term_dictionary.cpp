@@ -0,0 +1,128 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+int TermDictionary::Find(const string_view& word) const {
+    const auto it = term_to_id_.find(word);
+    if (it == term_to_id_.end()) {
+        return NO_TERM;
+    }
+    return it->second;
+}
+
+int TermDictionary::Acquire(const string_view& word, int references) {
+    const auto it = term_to_id_.find(word);
+    if (it != term_to_id_.end()) {
+        entries_[it->second].refs += references;
+        return it->second;
+    }
+
+    int term_id;
+    if (!free_ids_.empty()) {
+        term_id = free_ids_.back();
+        free_ids_.pop_back();
+    }
+    else {
+        term_id = static_cast<int>(entries_.size());
+        entries_.emplace_back();
+    }
+    const auto [text, block] = arena_.Allocate(word);
+    entries_[term_id] = { text, block, references };
+    term_to_id_.emplace(text, term_id);
+    return term_id;
+}
+
+bool TermDictionary::Release(int term_id, int references) {
+    Entry& entry = entries_.at(term_id);
+    entry.refs -= references;
+    if (entry.refs > 0) {
+        return false;
+    }
+    term_to_id_.erase(entry.text);
+    arena_.Free(entry.block);
+    entry = {};
+    free_ids_.push_back(term_id);
+    return true;
+}
+
+const string_view& TermDictionary::GetTerm(int term_id) const {
+    return entries_.at(term_id).text;
+}
+
+int TermDictionary::GetRefCount(int term_id) const {
+    return entries_.at(term_id).refs;
+}
+
+size_t TermDictionary::GetIdLimit() const {
+    return entries_.size();
+}
+
+size_t TermDictionary::GetTermCount() const {
+    return term_to_id_.size();
+}
+
+size_t TermDictionary::GetArenaBytes() const {
+    return arena_.GetAllocatedBytes();
+}
+
+pair<string_view, int> TermDictionary::Arena::Allocate(const string_view& word) {
+    if (current_ < 0 || blocks_[current_].capacity - blocks_[current_].used < word.size()) {
+        const int previous = current_;
+        current_ = NewBlock(max(BLOCK_SIZE, word.size()));
+        if (previous >= 0 && blocks_[previous].live == 0) {
+            ReleaseBlock(previous);
+        }
+    }
+    Block& block = blocks_[current_];
+    char* dest = block.data.get() + block.used;
+    if (!word.empty()) {
+        memcpy(dest, word.data(), word.size());
+    }
+    block.used += word.size();
+    ++block.live;
+    return { string_view(dest, word.size()), current_ };
+}
+
+void TermDictionary::Arena::Free(int block_index) {
+    Block& block = blocks_.at(block_index);
+    if (--block.live > 0) {
+        return;
+    }
+    if (block_index == current_) {
+        // Nothing points into the current block anymore, so it can be refilled from the start
+        block.used = 0;
+        return;
+    }
+    ReleaseBlock(block_index);
+}
+
+void TermDictionary::Arena::ReleaseBlock(int block_index) {
+    Block& block = blocks_[block_index];
+    allocated_bytes_ -= block.capacity;
+    block = {};
+    free_blocks_.push_back(block_index);
+}
+
+size_t TermDictionary::Arena::GetAllocatedBytes() const {
+    return allocated_bytes_;
+}
+
+int TermDictionary::Arena::NewBlock(size_t capacity) {
+    int index;
+    if (!free_blocks_.empty()) {
+        index = free_blocks_.back();
+        free_blocks_.pop_back();
+    }
+    else {
+        index = static_cast<int>(blocks_.size());
+        blocks_.emplace_back();
+    }
+    Block& block = blocks_[index];
+    block.data = make_unique<char[]>(capacity);
+    block.capacity = capacity;
+    block.used = 0;
+    block.live = 0;
+    allocated_bytes_ += capacity;
+    return index;
+}
\ No newline at end of file
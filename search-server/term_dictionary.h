@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Interns every distinct word once and hands out dense term ids.
+// Terms are reference counted: when the last reference is released,
+// the id is recycled and the characters are given back to the arena.
+class TermDictionary {
+public:
+    static constexpr int NO_TERM = -1;
+
+    int Find(const string_view& word) const;
+
+    // Takes references for that many documents at once
+    int Acquire(const string_view& word, int references = 1);
+
+    // Returns true if those were the last references and the term is gone
+    bool Release(int term_id, int references = 1);
+
+    const string_view& GetTerm(int term_id) const;
+
+    int GetRefCount(int term_id) const;
+
+    // Upper bound of term ids handed out so far
+    size_t GetIdLimit() const;
+
+    size_t GetTermCount() const;
+
+    size_t GetArenaBytes() const;
+
+private:
+    // Words are copied into large blocks; a block is freed once no live term points into it
+    class Arena {
+    public:
+        pair<string_view, int> Allocate(const string_view& word);
+
+        void Free(int block_index);
+
+        size_t GetAllocatedBytes() const;
+
+    private:
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+        struct Block {
+            unique_ptr<char[]> data;
+            size_t capacity = 0;
+            size_t used = 0;
+            size_t live = 0;
+        };
+
+        vector<Block> blocks_;
+        vector<int> free_blocks_;
+        int current_ = -1;
+        size_t allocated_bytes_ = 0;
+
+        int NewBlock(size_t capacity);
+
+        void ReleaseBlock(int block_index);
+    };
+
+    struct Entry {
+        string_view text;
+        int block = -1;
+        int refs = 0;
+    };
+
+    Arena arena_;
+
+    unordered_map<string_view, int> term_to_id_;
+
+    vector<Entry> entries_;
+
+    vector<int> free_ids_;
+};
\ No newline at end of file
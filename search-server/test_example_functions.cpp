@@ -113,6 +113,1251 @@ void TestStatusFilter() {
     }
 }
 
+void TestRemoveDocuments() {
+    SearchServer server;
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "white dog"s, DocumentStatus::ACTUAL, { 3 });
+
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+    ASSERT(server.GetWordFrequencies(1).empty());
+    vector<Document> docs = server.FindTopDocuments(execution::seq, "white"s);
+    ASSERT_EQUAL(docs.size(), 1);
+    ASSERT_EQUAL(docs[0].id, 3);
+
+    server.RemoveDocument(execution::par, 3);
+    ASSERT(server.FindTopDocuments(execution::par, "white dog"s).empty());
+    const auto [words, _] = server.MatchDocument(execution::par, "white cat -dog"s, 2);
+    ASSERT_EQUAL(words.size(), 1);
+    ASSERT_EQUAL(words[0], "cat"s);
+
+    server.AddDocument(4, "white parrot"s, DocumentStatus::ACTUAL, { 4 });
+    docs = server.FindTopDocuments(execution::seq, "white"s);
+    ASSERT_EQUAL(docs.size(), 1);
+    ASSERT_EQUAL(docs[0].id, 4);
+}
+
+void TestDocumentTextNotRequired() {
+    SearchServer server;
+    {
+        string text = "fluffy cat fluffy tail"s;
+        server.AddDocument(1, text, DocumentStatus::ACTUAL, { 1 });
+        text.assign(text.size(), 'x');
+    }
+    const auto& freqs = server.GetWordFrequencies(1);
+    ASSERT_EQUAL(freqs.size(), 3);
+    ASSERT(abs(freqs.at("fluffy"s) - 0.5) < EPSILON);
+    ASSERT_EQUAL(server.FindTopDocuments(execution::seq, "tail"s).size(), 1);
+
+    server.RemoveDocument(1);
+    server.AddDocument(2, string("tail"s), DocumentStatus::ACTUAL, { 1 });
+    ASSERT(server.FindTopDocuments(execution::seq, "fluffy"s).empty());
+    ASSERT_EQUAL(server.GetWordFrequencies(2).begin()->first, "tail"s);
+}
+
+void TestTopDocumentsCount() {
+    SearchServer server;
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, "cat"s + string(id % 7, 'x') + " cat dog"s, DocumentStatus::ACTUAL, { id % 10 });
+    }
+    ASSERT_EQUAL(server.FindTopDocuments(execution::seq, "cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT(server.FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL, 0).empty());
+
+    const vector<Document> seq_docs = server.FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL, 20);
+    const vector<Document> par_docs = server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, 20);
+    ASSERT_EQUAL(seq_docs.size(), 20);
+    ASSERT_EQUAL(par_docs.size(), 20);
+    for (size_t i = 0; i < seq_docs.size(); ++i) {
+        ASSERT_EQUAL(seq_docs[i].id, par_docs[i].id);
+        if (i > 0) {
+            ASSERT(!IsMoreRelevant(seq_docs[i], seq_docs[i - 1]));
+        }
+    }
+    ASSERT_EQUAL(seq_docs[0].rating, 9);
+
+    // Any K is accepted, however far it is beyond the documents there are
+    SearchServer small_server;
+    small_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    small_server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    const size_t huge_count = numeric_limits<size_t>::max();
+    ASSERT_EQUAL(small_server.FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL, huge_count).size(), 2);
+    ASSERT_EQUAL(small_server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, huge_count).size(), 2);
+    ASSERT_EQUAL(small_server.FindTopDocuments(retrieval::adaptive, "cat"s, DocumentStatus::ACTUAL, huge_count).size(), 2);
+    ASSERT_EQUAL(small_server.FindTopDocuments(retrieval::block_max_wand, "cat"s, DocumentStatus::ACTUAL, huge_count).size(), 2);
+    const vector<vector<Document>> batch = small_server.FindTopDocumentsBatch({ "cat"s, "white"s }, DocumentStatus::ACTUAL, huge_count);
+    ASSERT_EQUAL(batch[0].size(), 2);
+    ASSERT_EQUAL(batch[1].size(), 1);
+    vector<Document> documents;
+    vector<size_t> offsets;
+    small_server.FindTopDocumentsBatch({ "cat"s, "white"s }, documents, offsets, DocumentStatus::ACTUAL, huge_count);
+    ASSERT_EQUAL(documents.size(), 3);
+}
+
+void TestWandRetrieval() {
+    SearchServer server("and"s);
+    const vector<string> words = { "cat"s, "dog"s, "bird"s, "fish"s, "mouse"s, "horse"s };
+    for (int id = 0; id < 2000; ++id) {
+        string text = words[id % 2];
+        for (int i = 0; i < id % 5; ++i) {
+            text += " "s + words[(id / 7 + i) % words.size()];
+        }
+        server.AddDocument(id, text, id % 11 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 13 });
+    }
+    for (const string& query : { "cat"s, "cat dog"s, "bird fish -mouse"s, "horse cat -dog"s, "unknown"s }) {
+        for (const size_t count : { 1, 5, 50 }) {
+            const vector<Document> expected = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, count);
+            const vector<Document> wand = server.FindTopDocuments(retrieval::wand, query, DocumentStatus::ACTUAL, count);
+            const vector<Document> block_max_wand = server.FindTopDocuments(retrieval::block_max_wand, query, DocumentStatus::ACTUAL, count);
+            ASSERT_EQUAL(wand.size(), expected.size());
+            ASSERT_EQUAL(block_max_wand.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL_HINT(wand[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(block_max_wand[i].id, expected[i].id, query);
+                ASSERT_EQUAL(block_max_wand[i].relevance, expected[i].relevance);
+            }
+        }
+    }
+}
+
+void TestParallelMatchesSequential() {
+    SearchServer server;
+    for (int id = 0; id < 50000; ++id) {
+        const string text = (id % 2 ? "cat"s : "dog"s) + (id % 3 ? " bird"s : ""s) + (id % 5 ? ""s : " fish"s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 17 });
+    }
+    for (const string& query : { "cat bird"s, "cat -fish"s, "dog bird -cat"s, "-bird"s }) {
+        const vector<Document> seq_docs = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 30);
+        const vector<Document> par_docs = server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 30);
+        ASSERT_EQUAL_HINT(seq_docs.size(), par_docs.size(), query);
+        for (size_t i = 0; i < seq_docs.size(); ++i) {
+            ASSERT_EQUAL_HINT(seq_docs[i].id, par_docs[i].id, query);
+            ASSERT_EQUAL_HINT(seq_docs[i].relevance, par_docs[i].relevance, query);
+        }
+    }
+    ASSERT(server.FindTopDocuments(execution::par, "-bird"s).empty());
+
+    // Nested leases get accumulators of their own; only max_idle_count are kept afterwards
+    ScoreAccumulatorPool pool(2);
+    {
+        ScoreAccumulatorLease outer(pool);
+        ScoreAccumulatorLease middle(pool);
+        ScoreAccumulatorLease inner(pool);
+        ASSERT(&*outer != &*middle && &*middle != &*inner && &*outer != &*inner);
+        inner->Reset(1000);
+    }
+    ASSERT_EQUAL(pool.GetIdleCount(), 2u);
+    {
+        ScoreAccumulatorLease reused(pool);
+        ASSERT_EQUAL(pool.GetIdleCount(), 1u);
+    }
+    pool.Clear();
+    ASSERT_EQUAL(pool.GetIdleCount(), 0u);
+}
+
+void TestMinusWordsSkipScoring() {
+    SearchServer server;
+    for (int id = 0; id < 1000; ++id) {
+        const string text = (id % 10 == 0 ? "rare "s : ""s) + (id % 2 ? "dog"s : "bird"s) + (id % 20 == 0 ? " cat"s : ""s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+    }
+    // Heavy minus lists take the lookup path, light ones the exclusion marks
+    for (const string& query : { "rare -dog -bird"s, "rare -cat"s, "cat -rare"s }) {
+        for (const bool parallel : { false, true }) {
+            bool excluded_scored = false;
+            const auto predicate = [&excluded_scored](int document_id, DocumentStatus, int) {
+                excluded_scored = excluded_scored || document_id % 20 == 0;
+                return true;
+            };
+            const vector<Document> docs = parallel
+                ? server.FindTopDocuments(execution::par, query, predicate, 1000)
+                : server.FindTopDocuments(execution::seq, query, predicate, 1000);
+            ASSERT_HINT(!excluded_scored, query);
+            if (query == "rare -cat"s) {
+                ASSERT_EQUAL(docs.size(), 50);
+            }
+            else {
+                ASSERT(docs.empty());
+            }
+        }
+    }
+}
+
+void TestAddDocumentsBatch() {
+    vector<tuple<int, string, DocumentStatus, vector<int>>> documents;
+    for (int id = 0; id < 2000; ++id) {
+        const string text = (id % 2 ? "cat"s : "dog"s) + (id % 3 ? " bird"s : " cat"s) + (id % 7 ? ""s : " fish in the city"s);
+        documents.push_back({ id, text, id % 4 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 11, 3 } });
+    }
+    SearchServer expected("in the"s);
+    SearchServer seq_server("in the"s);
+    SearchServer par_server("in the"s);
+    for (const auto& [id, text, status, ratings] : documents) {
+        expected.AddDocument(id, text, status, ratings);
+    }
+    // The second half goes on top of documents that are already indexed
+    const vector<tuple<int, string, DocumentStatus, vector<int>>> first_half(documents.begin(), documents.begin() + 1000);
+    const vector<tuple<int, string, DocumentStatus, vector<int>>> second_half(documents.begin() + 1000, documents.end());
+    seq_server.AddDocuments(first_half);
+    seq_server.AddDocuments(second_half);
+    par_server.AddDocuments(execution::par, first_half);
+    par_server.AddDocuments(execution::par, second_half);
+
+    for (const SearchServer* server : { &seq_server, &par_server }) {
+        ASSERT_EQUAL(server->GetDocumentCount(), expected.GetDocumentCount());
+        ASSERT(server->GetWordFrequencies(7) == expected.GetWordFrequencies(7));
+        for (const string& query : { "cat bird"s, "fish -dog"s, "city cat -bird"s }) {
+            const vector<Document> expected_docs = expected.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+            const vector<Document> docs = server->FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+            ASSERT_EQUAL_HINT(docs.size(), expected_docs.size(), query);
+            for (size_t i = 0; i < docs.size(); ++i) {
+                ASSERT_EQUAL_HINT(docs[i].id, expected_docs[i].id, query);
+                ASSERT_EQUAL_HINT(docs[i].rating, expected_docs[i].rating, query);
+                ASSERT_HINT(abs(docs[i].relevance - expected_docs[i].relevance) < EPSILON, query);
+            }
+        }
+    }
+
+    // A bad document anywhere in the batch rejects the whole batch
+    const vector<vector<tuple<int, string, DocumentStatus, vector<int>>>> bad_batches = {
+        { { 5000, "cat"s, DocumentStatus::ACTUAL, { 1 } }, { 5, "dog"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 5000, "cat"s, DocumentStatus::ACTUAL, { 1 } }, { 5000, "dog"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 5000, "cat"s, DocumentStatus::ACTUAL, { 1 } }, { -1, "dog"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 5000, "cat"s, DocumentStatus::ACTUAL, { 1 } }, { 5001, "d\x12og"s, DocumentStatus::ACTUAL, { 1 } } },
+    };
+    for (const auto& batch : bad_batches) {
+        for (const bool parallel : { false, true }) {
+            try {
+                if (parallel) {
+                    par_server.AddDocuments(execution::par, batch);
+                }
+                else {
+                    par_server.AddDocuments(execution::seq, batch);
+                }
+                ASSERT_HINT(false, "Bad batch must throw"s);
+            }
+            catch (const invalid_argument&) {
+            }
+            ASSERT_EQUAL(par_server.GetDocumentCount(), 2000);
+            ASSERT(par_server.FindTopDocuments("cat"s).size() > 0);
+        }
+    }
+}
+
+void TestSnapshotRoundTrip() {
+    const string path = "test_snapshot.bin"s;
+    SearchServer server("in the"s);
+    for (int id = 0; id < 500; ++id) {
+        const string text = (id % 2 ? "cat"s : "dog"s) + (id % 3 ? " bird in the city"s : " cat"s) + (id % 7 ? ""s : " fish"s);
+        server.AddDocument(id, text, id % 5 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 13, 2 });
+    }
+    for (int id = 0; id < 500; id += 9) {
+        server.RemoveDocument(id);
+    }
+    server.AddDocument(9, "fish fish city"s, DocumentStatus::ACTUAL, { 4 });
+    server.SaveSnapshot(path);
+
+    const SearchServer loaded = SearchServer::LoadSnapshot(path);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), server.GetDocumentCount());
+    // A loaded index is a state of its own, never one a cache has seen before
+    ASSERT(loaded.GetGeneration() != server.GetGeneration());
+    ASSERT(loaded.GetGeneration() != SearchServer::LoadSnapshot(path).GetGeneration());
+    ASSERT(vector<int>(loaded.begin(), loaded.end()) == vector<int>(server.begin(), server.end()));
+    for (const int id : server) {
+        ASSERT(loaded.GetWordFrequencies(id) == server.GetWordFrequencies(id));
+        const auto [words, status] = server.MatchDocument("cat fish -dog"s, id);
+        const auto [loaded_words, loaded_status] = loaded.MatchDocument("cat fish -dog"s, id);
+        ASSERT(words == loaded_words);
+        ASSERT(status == loaded_status);
+    }
+    for (const string& query : { "cat bird"s, "fish -dog"s, "city in cat"s }) {
+        const vector<Document> docs = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+        const vector<Document> loaded_docs = loaded.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 50);
+        ASSERT_EQUAL_HINT(docs.size(), loaded_docs.size(), query);
+        for (size_t i = 0; i < docs.size(); ++i) {
+            ASSERT_EQUAL_HINT(docs[i].id, loaded_docs[i].id, query);
+            ASSERT_EQUAL_HINT(docs[i].relevance, loaded_docs[i].relevance, query);
+            ASSERT_EQUAL_HINT(docs[i].rating, loaded_docs[i].rating, query);
+        }
+    }
+
+    // A save abandoned halfway leaves the previous snapshot and no temporary file
+    {
+        SnapshotWriter writer(path);
+        writer.Write(static_cast<uint64_t>(1));
+    }
+    ASSERT(!ifstream(path + ".tmp"s));
+    ASSERT_EQUAL(SearchServer::LoadSnapshot(path).GetDocumentCount(), server.GetDocumentCount());
+    server.SaveSnapshot(path);
+    ASSERT(!ifstream(path + ".tmp"s));
+    ASSERT_EQUAL(SearchServer::LoadSnapshot(path).GetDocumentCount(), server.GetDocumentCount());
+
+    // A flipped byte must be caught by the checksum
+    {
+        fstream file(path, ios::in | ios::out | ios::binary);
+        file.seekg(0, ios::end);
+        const streamoff middle = static_cast<streamoff>(file.tellg()) / 2;
+        file.seekg(middle);
+        const char byte = static_cast<char>(file.get());
+        file.seekp(middle);
+        file.put(static_cast<char>(~byte));
+    }
+    bool corrupted_rejected = false;
+    try {
+        SearchServer::LoadSnapshot(path);
+    }
+    catch (const runtime_error&) {
+        corrupted_rejected = true;
+    }
+    ASSERT(corrupted_rejected);
+    remove(path.c_str());
+}
+
+void TestCorpusReader() {
+    const string long_text = "cat"s + string(100, 'x') + " dog"s;
+    const string corpus = "1\tACTUAL\t1 2 3\tcurly cat curly tail\n"s
+        + "\n"s
+        + "2\tBANNED\t-4,6\tnasty dog with big eyes\r\n"s
+        + "3\tACTUAL\t5\t"s + long_text + "\n"s
+        + "4\tIRRELEVANT\t7\tcat and dog"s;
+    // A tiny buffer makes the reader refill between batches and grow for the long line
+    istringstream input(corpus);
+    CorpusReader reader(input, 16);
+    SearchServer server("and with"s);
+    ASSERT_EQUAL(LoadCorpus(execution::par, server, reader, 2), 4u);
+    ASSERT_EQUAL(server.GetDocumentCount(), 4);
+    ASSERT_EQUAL(reader.GetLineNumber(), 5u);
+
+    SearchServer expected("and with"s);
+    expected.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
+    expected.AddDocument(2, "nasty dog with big eyes"s, DocumentStatus::BANNED, { -4, 6 });
+    expected.AddDocument(3, long_text, DocumentStatus::ACTUAL, { 5 });
+    expected.AddDocument(4, "cat and dog"s, DocumentStatus::IRRELEVANT, { 7 });
+    for (const int id : expected) {
+        ASSERT(server.GetWordFrequencies(id) == expected.GetWordFrequencies(id));
+    }
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED, DocumentStatus::IRRELEVANT }) {
+        const vector<Document> docs = server.FindTopDocuments(execution::seq, "cat dog"s, status);
+        const vector<Document> expected_docs = expected.FindTopDocuments(execution::seq, "cat dog"s, status);
+        ASSERT_EQUAL(docs.size(), expected_docs.size());
+        for (size_t i = 0; i < docs.size(); ++i) {
+            ASSERT_EQUAL(docs[i].id, expected_docs[i].id);
+            ASSERT_EQUAL(docs[i].rating, expected_docs[i].rating);
+        }
+    }
+
+    for (const string& bad_line : { "1\tACTUAL\tcat\n"s, "x\tACTUAL\t1\tcat\n"s, "1\tGOOD\t1\tcat\n"s, "1\tACTUAL\t\tcat\n"s, "1\tACTUAL\t1;2\tcat\n"s }) {
+        istringstream bad_input("7\tACTUAL\t1\tfine\n"s + bad_line);
+        CorpusReader bad_reader(bad_input);
+        bool is_rejected = false;
+        try {
+            bad_reader.ReadBatch();
+        }
+        catch (const invalid_argument& e) {
+            is_rejected = string(e.what()).find("line 2"s) != string::npos;
+        }
+        ASSERT_HINT(is_rejected, bad_line);
+    }
+}
+
+void TestTombstoneCompaction() {
+    SearchServer server;
+    SearchServer expected;
+    for (int id = 0; id < 3000; ++id) {
+        const string text = (id % 2 ? "cat"s : "dog"s) + (id % 3 ? " bird"s : ""s) + (id % 100 ? ""s : " unique"s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+        if (id % 4 != 0) {
+            expected.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+        }
+    }
+    const auto check_same = [&]() {
+        ASSERT_EQUAL(server.GetDocumentCount(), expected.GetDocumentCount());
+        for (const string& query : { "cat bird"s, "dog -bird"s, "unique"s, "unique cat -dog"s }) {
+            for (const bool parallel : { false, true }) {
+                const vector<Document> docs = parallel
+                    ? server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, 100)
+                    : server.FindTopDocuments(retrieval::block_max_wand, query, DocumentStatus::ACTUAL, 100);
+                const vector<Document> expected_docs = expected.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 100);
+                ASSERT_EQUAL_HINT(docs.size(), expected_docs.size(), query);
+                for (size_t i = 0; i < docs.size(); ++i) {
+                    ASSERT_EQUAL_HINT(docs[i].id, expected_docs[i].id, query);
+                    ASSERT_HINT(abs(docs[i].relevance - expected_docs[i].relevance) < EPSILON, query);
+                }
+            }
+        }
+    };
+
+    // Removal only leaves tombstones, yet document frequencies stay exact
+    for (int id = 0; id < 3000; id += 4) {
+        if (id % 8 == 0) {
+            server.RemoveDocument(id);
+        }
+        else {
+            server.RemoveDocument(execution::par, id);
+        }
+    }
+    ASSERT_EQUAL(server.GetRemovedDocumentCount(), 750u);
+    check_same();
+
+    ASSERT_EQUAL(server.CompactRemovedDocuments(100), 100u);
+    ASSERT_EQUAL(server.GetRemovedDocumentCount(), 650u);
+    check_same();
+    ASSERT_EQUAL(server.CompactRemovedDocuments(execution::par), 650u);
+    ASSERT_EQUAL(server.GetRemovedDocumentCount(), 0u);
+    check_same();
+
+    // Ids of removed documents can be used again
+    server.AddDocument(0, "unique parrot"s, DocumentStatus::ACTUAL, { 1 });
+    expected.AddDocument(0, "unique parrot"s, DocumentStatus::ACTUAL, { 1 });
+    check_same();
+}
+
+void TestConcurrentReadsDuringWrites() {
+    ConcurrentSearchServer server("and"s);
+    const int batch_count = 200;
+    atomic<bool> is_writing = true;
+    atomic<int> failures = 0;
+    atomic<int> queries = 0;
+
+    // Every version a reader sees must be whole: its index, ids and counters agree with each other
+    thread writer([&]() {
+        for (int batch = 0; batch < batch_count; ++batch) {
+            const vector<tuple<int, string, DocumentStatus, vector<int>>> documents = {
+                { 2 * batch, "cat and dog"s, DocumentStatus::ACTUAL, { batch } },
+                { 2 * batch + 1, "cat and bird"s, DocumentStatus::ACTUAL, { batch } },
+            };
+            server.AddDocuments(execution::seq, documents);
+            if (batch % 3 == 2) {
+                server.RemoveDocument(2 * batch - 4);
+                server.RemoveDocument(2 * batch - 3);
+            }
+            if (batch % 50 == 49) {
+                server.CompactRemovedDocuments();
+            }
+        }
+        is_writing = false;
+    });
+
+    vector<thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (is_writing) {
+                const auto snapshot = server.GetSnapshot();
+                const int document_count = snapshot->GetDocumentCount();
+                const vector<Document> docs = snapshot->FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL, 1000);
+                const vector<Document> dogs = server.FindTopDocuments(execution::seq, "dog -bird"s, DocumentStatus::ACTUAL, 1000);
+                if (static_cast<int>(docs.size()) != document_count
+                    || static_cast<int>(distance(snapshot->begin(), snapshot->end())) != document_count
+                    || any_of(dogs.begin(), dogs.end(), [](const Document& document) { return document.id % 2 != 0; })) {
+                    ++failures;
+                }
+                ++queries;
+            }
+        });
+    }
+    writer.join();
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQUAL(failures.load(), 0);
+
+    // Both copies went through the same changes
+    const int expected_count = 2 * batch_count - 2 * (batch_count / 3);
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_count);
+    server.RemoveDocument(2 * batch_count - 1);
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_count - 1);
+    server.AddDocument(1, "parrot"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.FindTopDocuments("parrot"s).size(), 1u);
+    const auto [words, status] = server.MatchDocument("parrot cat"s, 1);
+    ASSERT_EQUAL(words.size(), 1u);
+    ASSERT_EQUAL(words[0], "parrot"s);
+
+    // A snapshot held across writes: the first write goes to the other copy, the second
+    // sleeps until the snapshot is released, and the snapshot never changes meanwhile
+    ConcurrentSearchServer held_server;
+    auto held = held_server.GetSnapshot();
+    atomic<int> writes = 0;
+    thread held_writer([&]() {
+        held_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        ++writes;
+        held_server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, { 1 });
+        ++writes;
+    });
+    while (writes == 0) {
+        this_thread::yield();
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+    ASSERT_EQUAL(writes.load(), 1);
+    ASSERT_EQUAL(held_server.GetDocumentCount(), 1);
+    ASSERT_EQUAL(held->GetDocumentCount(), 0);
+    held.reset();
+    held_writer.join();
+    ASSERT_EQUAL(held_server.GetDocumentCount(), 2);
+
+    // A snapshot may outlive its server
+    shared_ptr<const SearchServer> orphan;
+    {
+        ConcurrentSearchServer short_lived;
+        short_lived.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        orphan = short_lived.GetSnapshot();
+    }
+    ASSERT_EQUAL(orphan->FindTopDocuments("cat"s).size(), 1u);
+}
+
+void TestIndexSegments() {
+    SearchServer server;
+    // Three sealed segments and a half-full open one
+    const int document_count = 3 * InvertedIndex::SEGMENT_DOCUMENT_COUNT + InvertedIndex::SEGMENT_DOCUMENT_COUNT / 2;
+    for (int id = 0; id < document_count; ++id) {
+        const string text = (id % 2 ? "cat"s : "dog"s) + (id % 3 ? " bird"s : ""s) + (id % 997 ? ""s : " rare"s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 13 });
+    }
+    for (int id = 0; id < document_count; id += 5) {
+        server.RemoveDocument(id);
+    }
+    ASSERT_EQUAL(server.GetIndexSegmentCount(), 4u);
+
+    const vector<string> queries = { "cat bird"s, "rare"s, "rare bird -dog"s, "dog -bird"s };
+    vector<vector<Document>> before;
+    for (const string& query : queries) {
+        before.push_back(server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, 20));
+    }
+    const auto check = [&]() {
+        for (size_t i = 0; i < queries.size(); ++i) {
+            for (const vector<Document>& docs : {
+                    server.FindTopDocuments(execution::seq, queries[i], DocumentStatus::ACTUAL, 20),
+                    server.FindTopDocuments(execution::par, queries[i], DocumentStatus::ACTUAL, 20),
+                    server.FindTopDocuments(retrieval::block_max_wand, queries[i], DocumentStatus::ACTUAL, 20) }) {
+                ASSERT_EQUAL_HINT(docs.size(), before[i].size(), queries[i]);
+                for (size_t j = 0; j < docs.size(); ++j) {
+                    ASSERT_EQUAL_HINT(docs[j].id, before[i][j].id, queries[i]);
+                    ASSERT_HINT(abs(docs[j].relevance - before[i][j].relevance) < EPSILON, queries[i]);
+                }
+            }
+        }
+        const auto [words, _] = server.MatchDocument("rare cat"s, 997 * 11);
+        ASSERT_EQUAL(words.size(), 2u);
+    };
+    check();
+
+    // Compaction and merging change the layout, not the answers
+    server.CompactRemovedDocuments();
+    check();
+    server.MergeIndexSegments();
+    ASSERT_EQUAL(server.GetIndexSegmentCount(), 2u);
+    check();
+
+    // Equal texts score equally in sealed and open segments, so the rating decides
+    SearchServer mixed;
+    const int sealed_id = 2;
+    const int open_id = InvertedIndex::SEGMENT_DOCUMENT_COUNT + 6;
+    for (int id = 0; id < InvertedIndex::SEGMENT_DOCUMENT_COUNT + 10; ++id) {
+        const int rating = id == sealed_id ? 2 : id == open_id ? 1 : 0;
+        mixed.AddDocument(id, id % 2 ? "parrot bird dog"s : "cat bird dog"s, DocumentStatus::ACTUAL, { rating });
+    }
+    const vector<Document> docs = mixed.FindTopDocuments(execution::seq, "cat"s);
+    ASSERT_EQUAL(docs.size(), 5u);
+    ASSERT_EQUAL(docs[0].id, sealed_id);
+    ASSERT_EQUAL(docs[1].id, open_id);
+    ASSERT_EQUAL(docs[2].id, 0);
+    ASSERT_EQUAL(docs[0].relevance, docs[1].relevance);
+}
+
+void TestCachedInverseDocumentFreq() {
+    SearchServer server;
+    server.AddDocument(1, "cat dog"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "dog"s, DocumentStatus::ACTUAL, { 1 });
+    const uint64_t generation = server.GetGeneration();
+    ASSERT(abs(server.FindTopDocuments("cat"s)[0].relevance - 0.5 * log(2.0)) < EPSILON);
+
+    // Every change of the document count invalidates the cached values
+    server.AddDocument(3, "bird"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(server.GetGeneration() != generation);
+    ASSERT(abs(server.FindTopDocuments("cat"s)[0].relevance - 0.5 * log(3.0)) < EPSILON);
+    ASSERT(abs(server.FindTopDocuments(execution::par, "dog"s)[0].relevance - log(1.5)) < EPSILON);
+
+    server.RemoveDocument(2);
+    ASSERT(abs(server.FindTopDocuments("dog"s)[0].relevance - 0.5 * log(2.0)) < EPSILON);
+    ASSERT(abs(server.FindTopDocuments(retrieval::wand, "cat"s)[0].relevance - 0.5 * log(2.0)) < EPSILON);
+}
+
+void TestCompressedPostings() {
+    mt19937 generator(15);
+    for (const size_t count : { PACKED_BLOCK_SIZE, size_t(1), size_t(37) }) {
+        for (int bit_width = 0; bit_width <= 32; ++bit_width) {
+            uint32_t values[PACKED_BLOCK_SIZE];
+            for (uint32_t& value : values) {
+                value = bit_width == 0 ? 0 : static_cast<uint32_t>(generator()) >> (32 - bit_width);
+            }
+            vector<uint32_t> words(GetPackedWordCount(bit_width, count));
+            PackBlock(values, count, bit_width, words.data());
+            uint32_t unpacked[PACKED_BLOCK_SIZE];
+            uint32_t unpacked_scalar[PACKED_BLOCK_SIZE];
+            UnpackBlock(words.data(), count, bit_width, unpacked);
+            UnpackBlockScalar(words.data(), count, bit_width, unpacked_scalar);
+            ASSERT(equal(values, values + count, unpacked));
+            ASSERT(equal(values, values + count, unpacked_scalar));
+        }
+    }
+
+    for (int words = 1; words <= 5000; ++words) {
+        for (int count = 1; count <= min(words, 40); ++count) {
+            const double term_freq = count * 1.0 / words;
+            const uint16_t code = QuantizeTermFreq(term_freq);
+            const double stored = DequantizeTermFreq(code);
+            ASSERT(abs(stored - term_freq) <= term_freq / 4096);
+            ASSERT_EQUAL(QuantizeTermFreq(stored), code);
+        }
+    }
+
+    // Sealed segments store the postings compressed, with exact term frequencies by default
+    // and quantized ones on request; scores stay within the documented bound
+    const int document_count = InvertedIndex::SEGMENT_DOCUMENT_COUNT / 2;
+    int bird_document_count = 0;
+    const auto make_server = [&](bool quantize) {
+        SearchServer server;
+        server.SetTermFreqQuantization(quantize);
+        bird_document_count = 0;
+        for (int id = 0; id < document_count; ++id) {
+            string text = "cat"s;
+            for (int i = 0; i < id % 7; ++i) {
+                text += " bird"s;
+            }
+            server.AddDocument(id * 3, text, DocumentStatus::ACTUAL, { id });
+            bird_document_count += id % 7 > 0;
+        }
+        return server;
+    };
+    SearchServer exact_server = make_server(false);
+    const vector<Document> open_documents = exact_server.FindTopDocuments(execution::seq, "bird"s, DocumentStatus::ACTUAL, document_count);
+    const size_t open_memory = exact_server.GetPostingsMemoryUsage();
+    exact_server.MergeIndexSegments();
+    ASSERT(exact_server.GetPostingsMemoryUsage() * 3 < open_memory * 2);
+    const vector<Document> exact_documents = exact_server.FindTopDocuments(execution::seq, "bird"s, DocumentStatus::ACTUAL, document_count);
+    ASSERT_EQUAL(exact_documents.size(), open_documents.size());
+    for (size_t i = 0; i < exact_documents.size(); ++i) {
+        ASSERT_EQUAL(exact_documents[i].id, open_documents[i].id);
+        ASSERT_EQUAL(exact_documents[i].relevance, open_documents[i].relevance);
+    }
+
+    SearchServer server = make_server(true);
+    server.MergeIndexSegments();
+    ASSERT(server.GetPostingsMemoryUsage() * 3 < open_memory);
+    const vector<Document> documents = server.FindTopDocuments(execution::seq, "bird"s, DocumentStatus::ACTUAL, document_count);
+    ASSERT(!documents.empty());
+    for (const Document& document : documents) {
+        const int words = document.id / 3 % 7;
+        const double exact = log(document_count * 1.0 / bird_document_count) * words / (words + 1);
+        ASSERT(abs(document.relevance - exact) <= exact / 4096 + EPSILON);
+        ASSERT_EQUAL(get<0>(server.MatchDocument("bird"s, document.id)).size(), 1u);
+    }
+    ASSERT(get<0>(server.MatchDocument("bird"s, 0)).empty());
+
+    // A snapshot keeps the open segment apart, so loading quantizes nothing new
+    server.AddDocument(1, "cat bird bird"s, DocumentStatus::ACTUAL, { 1 });
+    const string path = "test_compressed_snapshot.bin"s;
+    server.SaveSnapshot(path);
+    const SearchServer loaded = SearchServer::LoadSnapshot(path);
+    remove(path.c_str());
+    ASSERT(loaded.IsTermFreqQuantized());
+    const vector<Document> loaded_documents = loaded.FindTopDocuments(execution::seq, "bird"s, DocumentStatus::ACTUAL, document_count);
+    const vector<Document> saved_documents = server.FindTopDocuments(execution::seq, "bird"s, DocumentStatus::ACTUAL, document_count);
+    ASSERT_EQUAL(loaded_documents.size(), saved_documents.size());
+    for (size_t i = 0; i < saved_documents.size(); ++i) {
+        ASSERT_EQUAL(loaded_documents[i].id, saved_documents[i].id);
+        ASSERT_EQUAL(loaded_documents[i].relevance, saved_documents[i].relevance);
+    }
+}
+
+void TestSplitIntoWords() {
+    mt19937 generator(16);
+    const string alphabet = "ab -\x01\x1f\x7f\x80\xff"s;
+    vector<string_view> words;
+    for (int length = 0; length < 200; ++length) {
+        for (int attempt = 0; attempt < 20; ++attempt) {
+            string text;
+            for (int i = 0; i < length; ++i) {
+                // Mostly letters and spaces, now and then something else
+                const size_t choice = generator() % 40;
+                text += choice < alphabet.size() ? alphabet[choice] : choice % 3 ? 'x' : ' ';
+            }
+
+            vector<string_view> expected;
+            size_t expected_invalid = string::npos;
+            string_view rest = text;
+            while (true) {
+                const size_t space = rest.find(' ');
+                expected.push_back(rest.substr(0, space));
+                const string_view word = expected.back();
+                if (expected_invalid == string::npos && any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; })) {
+                    expected_invalid = expected.size() - 1;
+                }
+                if (space == rest.npos) {
+                    break;
+                }
+                rest.remove_prefix(space + 1);
+            }
+
+            const size_t invalid = SplitIntoWords(text, words);
+            ASSERT(words == expected);
+            ASSERT_EQUAL(invalid, expected_invalid == string::npos ? expected.size() : expected_invalid);
+            ASSERT_EQUAL(ContainsControlChar(text), expected_invalid != string::npos);
+        }
+    }
+
+    // The buffer is reused instead of reallocated
+    SplitIntoWords("a b c d e f g"s, words);
+    const string_view* data = words.data();
+    SplitIntoWords("x y"s, words);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT(words.data() == data);
+
+    SearchServer server;
+    const string long_text = string(40, 'a') + " b\x05"s;
+    try {
+        server.AddDocument(1, long_text, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_HINT(false, "A control character must be rejected"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), 0);
+}
+
+void TestStopWordSet() {
+    // Several hundred stop words of many lengths, with duplicates and empty strings
+    mt19937 generator(17);
+    vector<string> stop_words(2);
+    for (int i = 0; i < 600; ++i) {
+        string word(1 + generator() % 12, ' ');
+        for (char& c : word) {
+            c = static_cast<char>('a' + generator() % 4);
+        }
+        stop_words.push_back(word);
+    }
+    const set<string, less<>> expected = MakeUniqueNonEmptyStrings(stop_words);
+    const StopWordSet stop_word_set(stop_words);
+    ASSERT_EQUAL(stop_word_set.size(), expected.size());
+    ASSERT(equal(stop_word_set.begin(), stop_word_set.end(), expected.begin(), expected.end()));
+    ASSERT(!stop_word_set.Contains(""sv));
+    for (int length = 0; length <= 5; ++length) {
+        // Every word of up to 5 letters over a slightly larger alphabet
+        string word(length, 'a');
+        while (true) {
+            ASSERT_EQUAL(stop_word_set.Contains(word), expected.count(word) > 0);
+            int position = 0;
+            while (position < length && word[position] == 'e') {
+                word[position++] = 'a';
+            }
+            if (position == length) {
+                break;
+            }
+            ++word[position];
+        }
+    }
+    ASSERT(!StopWordSet().Contains("a"sv));
+
+    // A built-in list compiled at construction time
+    static constexpr string_view BUILT_IN[] = { "and"sv, "in"sv, ""sv, "the"sv, "in"sv };
+    static constexpr FixedStopWordSet BUILT_IN_SET(BUILT_IN);
+    static_assert(BUILT_IN_SET.size() == 3);
+    static_assert(BUILT_IN_SET.Contains("the"sv) && !BUILT_IN_SET.Contains("they"sv) && !BUILT_IN_SET.Contains(""sv));
+    static_assert(*BUILT_IN_SET.begin() == "and"sv && *(BUILT_IN_SET.end() - 1) == "the"sv);
+
+    // The table is taken over as it is and answers like one built at run time
+    const StopWordSet adopted(BUILT_IN_SET);
+    const StopWordSet built(vector<string>{ "the"s, "in"s, "and"s });
+    ASSERT(equal(adopted.begin(), adopted.end(), built.begin(), built.end()));
+    for (const string_view word : { "and"sv, "in"sv, "the"sv, ""sv, "a"sv, "an"sv, "then"sv, "i"sv }) {
+        ASSERT_EQUAL_HINT(adopted.Contains(word), built.Contains(word), string(word));
+    }
+
+    SearchServer server(BUILT_IN_SET);
+    server.AddDocument(1, "the cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    const auto [words, status] = server.MatchDocument("the cat"s, 1);
+    ASSERT_EQUAL(words.size(), 1u);
+    ASSERT_EQUAL(words[0], "cat"s);
+    ASSERT_EQUAL(server.GetWordFrequencies(1).count("in"s), 0u);
+}
+
+void TestQueryResultCache() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, { 8 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, { 5 });
+
+    ASSERT_EQUAL(server.NormalizeQuery("fluffy -dog and cat -dog fluffy"s), "cat fluffy -dog"s);
+    ASSERT_EQUAL(server.NormalizeQuery("and"s), ""s);
+
+    QueryResultCache cache(server, 2);
+    const auto expected = server.FindTopDocuments("fluffy cat"s);
+    // Queries of the same normalized form share an entry
+    for (const string& query : { "fluffy cat"s, "cat fluffy"s, "cat and fluffy cat"s }) {
+        const auto documents = cache.FindTopDocuments(query);
+        ASSERT_EQUAL(documents.size(), expected.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ASSERT_EQUAL(documents[i].id, expected[i].id);
+            ASSERT_EQUAL(documents[i].relevance, expected[i].relevance);
+        }
+    }
+    ASSERT_EQUAL(cache.GetMissCount(), 1u);
+    ASSERT_EQUAL(cache.GetHitCount(), 2u);
+
+    // Status and the number of documents are parts of the key
+    ASSERT_EQUAL(cache.FindTopDocuments("dog"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(cache.FindTopDocuments(execution::par, "fluffy cat"s, DocumentStatus::ACTUAL, 1).size(), 1u);
+    ASSERT_EQUAL(cache.GetMissCount(), 3u);
+    ASSERT_EQUAL(cache.GetSize(), 2u);
+
+    // A change of the index invalidates the entries
+    server.AddDocument(4, "fluffy dog"s, DocumentStatus::BANNED, { 1 });
+    ASSERT_EQUAL(cache.FindTopDocuments("dog"s, DocumentStatus::BANNED).size(), 2u);
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(cache.FindTopDocuments("dog"s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(cache.GetMissCount(), 5u);
+    ASSERT_EQUAL(cache.GetSize(), 2u);
+
+    // Errors are not cached
+    try {
+        cache.FindTopDocuments("--cat"s);
+        ASSERT_HINT(false, "An invalid query must throw"s);
+    }
+    catch (const invalid_argument&) {
+    }
+    ASSERT_EQUAL(cache.GetSize(), 2u);
+
+    // The clock evicts entries that were not hit since it last passed them
+    QueryResultCache small_cache(server, 2);
+    small_cache.FindTopDocuments("cat"s);
+    small_cache.FindTopDocuments("dog"s);
+    small_cache.FindTopDocuments("cat"s);
+    small_cache.FindTopDocuments("tail"s);
+    small_cache.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(small_cache.GetHitCount(), 2u);
+    small_cache.FindTopDocuments("dog"s);
+    ASSERT_EQUAL(small_cache.GetHitCount(), 2u);
+
+    RequestQueue queue(server, cache);
+    const uint64_t hits = cache.GetHitCount();
+    queue.AddFindRequest("dog"s, DocumentStatus::BANNED);
+    queue.AddFindRequest("parrot"s);
+    ASSERT_EQUAL(cache.GetHitCount(), hits + 1);
+    ASSERT_EQUAL(queue.GetNoResultRequests(), 1);
+    ASSERT_EQUAL(queue.AddFindRequest("cat"s, [](int document_id, DocumentStatus, int) { return document_id == 2; }).size(), 1u);
+}
+
+void TestQueryBatch() {
+    ThreadPool pool(3, true);
+    ASSERT_EQUAL(pool.GetThreadCount(), 3u);
+    vector<int> squares(1000);
+    pool.ParallelFor(squares.size(), [&](size_t i) {
+        // Nested calls run on the same pool
+        vector<int> parts(10);
+        pool.ParallelFor(parts.size(), [&](size_t j) { parts[j] = static_cast<int>(i); });
+        squares[i] = accumulate(parts.begin(), parts.end(), 0) / 10 * static_cast<int>(i);
+    });
+    for (size_t i = 0; i < squares.size(); ++i) {
+        ASSERT_EQUAL(squares[i], static_cast<int>(i * i));
+    }
+    try {
+        pool.ParallelFor(100, [](size_t i) {
+            if (i == 42) {
+                throw out_of_range("42"s);
+            }
+        });
+        ASSERT_HINT(false, "An exception of a call must reach the caller"s);
+    }
+    catch (const out_of_range&) {
+    }
+    pool.Configure(2);
+    ASSERT_EQUAL(pool.GetThreadCount(), 2u);
+
+    // Compressed segments and the open one, removed documents included
+    mt19937 generator(19);
+    SearchServer server("and"s);
+    server.GetThreadPool().Configure(3);
+    const vector<string> words = { "and"s, "cat"s, "dog"s, "bird"s, "fish"s, "rare"s, "tail"s, "collar"s };
+    const int document_count = InvertedIndex::SEGMENT_DOCUMENT_COUNT + 500;
+    for (int id = 0; id < document_count; ++id) {
+        string text = words[generator() % words.size()];
+        for (int i = 0; i < 5; ++i) {
+            text += " "s + words[generator() % 5];
+        }
+        server.AddDocument(id, text, id % 7 ? DocumentStatus::ACTUAL : DocumentStatus::BANNED, { id % 11 });
+    }
+    for (int id = 0; id < document_count; id += 9) {
+        server.RemoveDocument(id);
+    }
+
+    vector<string> queries;
+    for (int i = 0; i < 200; ++i) {
+        string query;
+        for (int j = 0, length = 1 + generator() % 3; j < length; ++j) {
+            query += (j > 0 ? " "s : ""s) + (generator() % 5 ? ""s : "-"s) + words[generator() % words.size()];
+        }
+        queries.push_back(query);
+    }
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        const vector<vector<Document>> results = server.FindTopDocumentsBatch(queries, status, 10);
+        ASSERT_EQUAL(results.size(), queries.size());
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const vector<Document> expected = server.FindTopDocuments(execution::seq, queries[i], status, 10);
+            ASSERT_EQUAL_HINT(results[i].size(), expected.size(), queries[i]);
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_EQUAL_HINT(results[i][j].id, expected[j].id, queries[i]);
+                ASSERT_EQUAL_HINT(results[i][j].relevance, expected[j].relevance, queries[i]);
+            }
+        }
+    }
+    ASSERT_EQUAL(ProcessQueries(server, queries).size(), queries.size());
+    ASSERT(server.FindTopDocumentsBatch({}).empty());
+
+    try {
+        server.FindTopDocumentsBatch({ "cat"s, "--dog"s, "fish -"s });
+        ASSERT_HINT(false, "An invalid query must throw"s);
+    }
+    catch (const invalid_argument& error) {
+        ASSERT_EQUAL(string(error.what()), "Query word --dog is invalid"s);
+    }
+}
+
+void TestProcessQueriesJoined() {
+    SearchServer server("and with"s);
+    int id = 0;
+    for (const string& text : { "funny pet and nasty rat"s, "funny pet with curly hair"s, "funny pet and not very nasty rat"s, "pet with rat and rat and rat"s,
+            "nasty rat with curly hair"s, "big cat nasty hair"s, "big dog cat Vladislav"s, "big cat dog"s }) {
+        server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+    }
+    const vector<string> queries = { "nasty rat -not"s, "parrot"s, "not very funny nasty pet"s, "curly hair"s, "big"s };
+    const vector<vector<Document>> expected = ProcessQueries(server, queries);
+    const JoinedDocuments joined = ProcessQueriesJoined(server, queries);
+    ASSERT_EQUAL(joined.GetQueryCount(), queries.size());
+
+    size_t total = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto documents = joined.GetQueryDocuments(i);
+        ASSERT_EQUAL(documents.size(), expected[i].size());
+        ASSERT(equal(documents.begin(), documents.end(), expected[i].begin(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        }));
+        total += documents.size();
+    }
+    ASSERT_EQUAL(joined.size(), total);
+    ASSERT(joined.GetQueryDocuments(1).size() == 0);
+
+    // Streams query after query
+    size_t position = 0;
+    for (const Document& document : joined) {
+        ASSERT_EQUAL(document.id, joined[position++].id);
+    }
+    ASSERT_EQUAL(joined[0].id, expected[0][0].id);
+
+    ASSERT(ProcessQueriesJoined(server, {}).empty());
+    ASSERT(ProcessQueriesJoined(SearchServer(), { "cat"s }).empty());
+}
+
+void TestRemoveDuplicates() {
+    const auto make_server = []() {
+        SearchServer server("and with"s);
+        int id = 0;
+        for (const string& text : { "funny pet and nasty rat"s, "funny pet with curly hair"s, "funny pet with curly hair"s, "funny pet and curly hair"s,
+                "funny funny pet and nasty nasty rat"s, "funny pet and not very nasty rat"s, "very nasty rat and not very funny pet"s,
+                "pet with rat and rat and rat"s, "nasty rat with curly hair"s, "and with"s, "with"s }) {
+            server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1 });
+        }
+        return server;
+    };
+    const auto run = [](SearchServer& server, auto remove) {
+        ostringstream output;
+        streambuf* const old_buffer = cout.rdbuf(output.rdbuf());
+        remove(server);
+        cout.rdbuf(old_buffer);
+        return output.str();
+    };
+
+    {
+        SearchServer server = make_server();
+        const string report = run(server, [](SearchServer& server) { RemoveDuplicates(server); });
+        ASSERT_EQUAL(report, "Found duplicate document id 3\nFound duplicate document id 4\nFound duplicate document id 5\nFound duplicate document id 7\n"s);
+        ASSERT_EQUAL(server.GetDocumentCount(), 7);
+    }
+    {
+        // Identical word sets only, like the exact mode
+        SearchServer server = make_server();
+        const string report = run(server, [](SearchServer& server) { RemoveNearDuplicates(server, 1.0); });
+        ASSERT_EQUAL(report, "Found duplicate document id 3\nFound duplicate document id 4\nFound duplicate document id 5\nFound duplicate document id 7\n"s);
+    }
+
+    // Ten words, of which pairs share nine: a Jaccard similarity of 9/11
+    SearchServer server;
+    const vector<string> words = { "a"s, "b"s, "c"s, "d"s, "e"s, "f"s, "g"s, "h"s, "i"s };
+    const string common = "a b c d e f g h i"s;
+    server.AddDocument(5, common + " x"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(7, common + " y"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(9, "p q r s t u v w x y"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(11, common + " z"s, DocumentStatus::ACTUAL, { 1 });
+    run(server, [](SearchServer& server) { RemoveNearDuplicates(server, 0.9); });
+    ASSERT_EQUAL(server.GetDocumentCount(), 4);
+    const string report = run(server, [](SearchServer& server) { RemoveNearDuplicates(server, 0.8); });
+    ASSERT_EQUAL(report, "Found duplicate document id 7\nFound duplicate document id 11\n"s);
+    ASSERT_EQUAL(server.GetDocumentCount(), 2);
+
+    // One large cluster shares its buckets; every document but the first goes in one pass
+    SearchServer cluster_server;
+    for (int id = 0; id < 5000; ++id) {
+        cluster_server.AddDocument(id, common + " j k l m n o p q r s w"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    run(cluster_server, [](SearchServer& server) { RemoveNearDuplicates(server, 0.8); });
+    ASSERT_EQUAL(cluster_server.GetDocumentCount(), 1);
+    ASSERT_EQUAL(*cluster_server.begin(), 0);
+
+    try {
+        RemoveNearDuplicates(server, 0.0);
+        ASSERT_HINT(false, "A threshold out of (0, 1] must throw"s);
+    }
+    catch (const invalid_argument&) {
+    }
+
+    // Many documents over few words, checked against a plain comparison of word sets
+    mt19937 generator(21);
+    SearchServer random_server;
+    set<set<string>> seen;
+    vector<int> expected;
+    for (int id = 0; id < 3000; ++id) {
+        string text;
+        set<string> text_words;
+        for (int i = 0, length = 1 + generator() % 4; i < length; ++i) {
+            const string& word = words[generator() % 5];
+            text += (i > 0 ? " "s : ""s) + word;
+            text_words.insert(word);
+        }
+        random_server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+        if (!seen.insert(text_words).second) {
+            expected.push_back(id);
+        }
+    }
+    run(random_server, [](SearchServer& server) { RemoveDuplicates(server); });
+    ASSERT_EQUAL(random_server.GetDocumentCount(), 3000 - static_cast<int>(expected.size()));
+    for (const int id : expected) {
+        ASSERT(random_server.GetWordFrequencies(id).empty());
+    }
+}
+
+void TestForwardIndex() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat and white collar"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "dog with a collar"s, DocumentStatus::BANNED, { 1 });
+    server.AddDocument(3, "collar white dog"s, DocumentStatus::ACTUAL, { 1 });
+
+    // Term ids ascend along the view and the words follow them
+    const vector<int> term_ids = server.GetDocumentTermIds(1);
+    ASSERT(is_sorted(term_ids.begin(), term_ids.end()));
+    const auto freqs = server.GetWordFrequencies(1);
+    ASSERT_EQUAL(freqs.size(), 3u);
+    ASSERT(abs(freqs.at("white"s) - 0.5) < EPSILON);
+    ASSERT_EQUAL(freqs.count("and"s), 0u);
+    ASSERT_EQUAL(freqs.count("dog"s), 0u);
+    map<string_view, double> copied(freqs.begin(), freqs.end());
+    ASSERT_EQUAL(copied.size(), 3u);
+    ASSERT(abs(copied.at("cat"s) - 0.25) < EPSILON);
+    // Iterators outlive the view they came from, as a reference to the old map did
+    auto it = server.GetWordFrequencies(1).begin();
+    const auto end = server.GetWordFrequencies(1).end();
+    size_t word_count = 0;
+    for (; it != end; ++it) {
+        ASSERT_EQUAL(copied.count(it->first), 1u);
+        ++word_count;
+    }
+    ASSERT_EQUAL(word_count, 3u);
+    try {
+        freqs.at("dog"s);
+        ASSERT_HINT(false, "at must throw for a missing word"s);
+    }
+    catch (const out_of_range&) {
+    }
+
+    // Matched words come in word order whatever the ids, and a minus word clears them
+    const auto [words, status] = server.MatchDocument("white collar cat -dog"s, 1);
+    ASSERT(words == vector<string_view>({ "cat"sv, "collar"sv, "white"sv }));
+    ASSERT(status == DocumentStatus::ACTUAL);
+    ASSERT(get<0>(server.MatchDocument("collar -dog"s, 3)).empty());
+    ASSERT(get<0>(server.MatchDocument(execution::par, "dog dog collar cat -cat"s, 2)) == vector<string_view>({ "collar"sv, "dog"sv }));
+    ASSERT(get<1>(server.MatchDocument(execution::par, "dog"s, 2)) == DocumentStatus::BANNED);
+
+    // Ids are recycled once a term is gone; views compare by words, not by ids
+    server.RemoveDocument(2);
+    server.CompactRemovedDocuments();
+    server.AddDocument(4, "a parrot with a collar"s, DocumentStatus::ACTUAL, { 1 });
+    SearchServer other("and"s);
+    other.AddDocument(4, "a parrot with a collar"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(server.GetWordFrequencies(4) == other.GetWordFrequencies(4));
+    ASSERT(server.GetWordFrequencies(4) != server.GetWordFrequencies(3));
+    ASSERT(get<0>(server.MatchDocument("parrot with collar"s, 4)) == vector<string_view>({ "collar"sv, "parrot"sv, "with"sv }));
+    ASSERT(server.GetWordFrequencies(2).empty());
+}
+
+void TestMatchDocumentsBatch() {
+    SearchServer server("and with"s);
+    const vector<string> texts = {
+        "white cat and fashionable collar"s,
+        "fluffy cat fluffy tail"s,
+        "groomed dog expressive eyes"s,
+        "groomed starling eugene"s,
+        ""s,
+        "cat with a collar and a tail"s,
+    };
+    for (size_t i = 0; i < texts.size(); ++i) {
+        server.AddDocument(static_cast<int>(i) + 1, texts[i], i == 3 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { 1 });
+    }
+    const vector<int> document_ids = { 6, 1, 2, 3, 4, 5, 2 };
+
+    // Unknown query words and stop words match nothing, a minus word empties only its documents
+    for (const string& query : { "tail cat collar unknown"s, "fluffy groomed cat -eyes"s, "and with"s, "collar -tail -missing"s }) {
+        const MatchedDocuments seq_matches = server.MatchDocuments(query, document_ids);
+        const MatchedDocuments par_matches = server.MatchDocuments(execution::par, query, document_ids);
+        ASSERT_EQUAL(seq_matches.size(), document_ids.size());
+        ASSERT_EQUAL(par_matches.size(), document_ids.size());
+        for (size_t i = 0; i < document_ids.size(); ++i) {
+            const auto expected = server.MatchDocument(query, document_ids[i]);
+            ASSERT_HINT(seq_matches[i] == expected, query);
+            ASSERT_HINT(par_matches[i] == expected, query);
+            ASSERT_EQUAL(seq_matches.GetWords(i).size(), get<0>(expected).size());
+            ASSERT(seq_matches.GetStatus(i) == get<1>(expected));
+        }
+    }
+    const auto [words, status] = server.MatchDocuments("tail cat collar"s, document_ids)[0];
+    ASSERT(words == vector<string_view>({ "cat"sv, "collar"sv, "tail"sv }));
+
+    ASSERT(server.MatchDocuments(execution::par, "cat"s, {}).empty());
+    try {
+        server.MatchDocuments(execution::par, "cat"s, { 1, 42 });
+        ASSERT_HINT(false, "an unknown document id must throw"s);
+    }
+    catch (const out_of_range&) {
+    }
+    try {
+        server.MatchDocuments("cat --collar"s, { 1 });
+        ASSERT_HINT(false, "an invalid query must throw"s);
+    }
+    catch (const invalid_argument&) {
+    }
+}
+
+void TestPreparedQuery() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+    server.AddDocument(4, "groomed parrot in a cage"s, DocumentStatus::BANNED, { 9 });
+
+    const string raw_query = "fluffy groomed cat cat -collar in"s;
+    const SearchServer::PreparedQuery query = server.Prepare(raw_query);
+    ASSERT(query.GetPlusWords() == vector<string>({ "cat"s, "fluffy"s, "groomed"s }));
+    ASSERT(query.GetMinusWords() == vector<string>({ "collar"s }));
+
+    const auto same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+    };
+    const auto check = [&](const SearchServer& target, const SearchServer::PreparedQuery& prepared) {
+        const auto is_even = [](int document_id, DocumentStatus, int) { return document_id % 2 == 0; };
+        ASSERT(same(target.FindTopDocuments(prepared), target.FindTopDocuments(raw_query)));
+        ASSERT(same(target.FindTopDocuments(prepared, DocumentStatus::BANNED), target.FindTopDocuments(raw_query, DocumentStatus::BANNED)));
+        ASSERT(same(target.FindTopDocuments(execution::par, prepared), target.FindTopDocuments(execution::par, raw_query)));
+        ASSERT(same(target.FindTopDocuments(execution::seq, prepared, is_even), target.FindTopDocuments(execution::seq, raw_query, is_even)));
+        ASSERT(same(target.FindTopDocuments(retrieval::wand, prepared, DocumentStatus::ACTUAL, 1), target.FindTopDocuments(retrieval::wand, raw_query, DocumentStatus::ACTUAL, 1)));
+        ASSERT(same(target.FindTopDocuments(retrieval::block_max_wand, prepared), target.FindTopDocuments(retrieval::block_max_wand, raw_query)));
+        for (const int document_id : target) {
+            ASSERT(target.MatchDocument(prepared, document_id) == target.MatchDocument(raw_query, document_id));
+            ASSERT(target.MatchDocument(execution::par, prepared, document_id) == target.MatchDocument(raw_query, document_id));
+        }
+        const vector<int> document_ids(target.begin(), target.end());
+        ASSERT(target.MatchDocuments(execution::par, prepared, document_ids)[0] == target.MatchDocument(raw_query, document_ids[0]));
+    };
+    check(server, query);
+    ASSERT_EQUAL(server.FindTopDocuments(query).size(), 2u);
+
+    // Once the hamster is compacted away, its term id goes to the new word; a stale query
+    // must look its words up again rather than match the recycled id
+    server.AddDocument(5, "hamster"s, DocumentStatus::BANNED, { 1 });
+    const SearchServer::PreparedQuery hamster = server.Prepare("hamster"s);
+    server.RemoveDocument(5);
+    server.CompactRemovedDocuments();
+    server.AddDocument(6, "zebra"s, DocumentStatus::BANNED, { 1 });
+    ASSERT(server.FindTopDocuments(hamster, DocumentStatus::BANNED).empty());
+    ASSERT(get<0>(server.MatchDocument(hamster, 6)).empty());
+    check(server, query);
+
+    SearchServer::PreparedQuery refreshed = query;
+    server.Revalidate(refreshed);
+    check(server, refreshed);
+
+    // A query prepared by one server works with another
+    SearchServer other("and in"s);
+    other.AddDocument(7, "fluffy groomed cat"s, DocumentStatus::ACTUAL, { 1 });
+    check(other, query);
+    ASSERT_EQUAL(other.FindTopDocuments(query).size(), 1u);
+
+    try {
+        server.Prepare("cat --collar"s);
+        ASSERT_HINT(false, "an invalid query must throw"s);
+    }
+    catch (const invalid_argument&) {
+    }
+}
+
+void TestAdaptiveExecution() {
+    SearchServer server;
+    // "common" is in every document, enough postings to split; "rare" is in a few
+    const int document_count = 20000;
+    for (int id = 0; id < document_count; ++id) {
+        const string text = "common word"s + to_string(id % 100) + (id % 1000 == 0 ? " rare"s : ""s);
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 7 });
+    }
+    const auto same = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& lhs, const Document& rhs) {
+            return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+        });
+    };
+
+    ASSERT(same(server.FindTopDocuments(retrieval::adaptive, "rare word3"s), server.FindTopDocuments(execution::seq, "rare word3"s)));
+    auto stats = server.GetAdaptiveExecutionStats();
+    ASSERT_EQUAL(stats.sequential_searches, 1u);
+    ASSERT_EQUAL(stats.parallel_searches, 0u);
+
+    // Splitting only pays off with more than one hardware thread
+    const auto is_odd = [](int document_id, DocumentStatus, int) { return document_id % 2 == 1; };
+    ASSERT(same(server.FindTopDocuments(retrieval::adaptive, "common rare -word5"s, is_odd), server.FindTopDocuments(execution::seq, "common rare -word5"s, is_odd)));
+    const SearchServer::PreparedQuery query = server.Prepare("common word7"s);
+    ASSERT(same(server.FindTopDocuments(retrieval::adaptive, query), server.FindTopDocuments(execution::seq, query)));
+    stats = server.GetAdaptiveExecutionStats();
+    if (thread::hardware_concurrency() > 1) {
+        ASSERT_EQUAL(stats.parallel_searches, 2u);
+        ASSERT(stats.parallel_search_parts >= 4u);
+    }
+    else {
+        ASSERT_EQUAL(stats.sequential_searches, 3u);
+    }
+    ASSERT_EQUAL(stats.sequential_searches + stats.parallel_searches, 3u);
+
+    // Matching goes to the pool for many documents, if the pool has several threads
+    server.GetThreadPool().Configure(2);
+    vector<int> document_ids(1000);
+    iota(document_ids.begin(), document_ids.end(), 0);
+    const vector<int> few_ids(document_ids.begin(), document_ids.begin() + 10);
+    const MatchedDocuments many = server.MatchDocuments(retrieval::adaptive, "rare common"s, document_ids);
+    const MatchedDocuments few = server.MatchDocuments(retrieval::adaptive, "rare common"s, few_ids);
+    ASSERT(many[0] == server.MatchDocument("rare common"s, 0));
+    ASSERT(few[1] == server.MatchDocument(retrieval::adaptive, "rare common"s, 1));
+    stats = server.GetAdaptiveExecutionStats();
+    ASSERT_EQUAL(stats.parallel_matches, 1u);
+    ASSERT_EQUAL(stats.sequential_matches, 2u);
+
+    server.ResetAdaptiveExecutionStats();
+    stats = server.GetAdaptiveExecutionStats();
+    ASSERT_EQUAL(stats.sequential_searches + stats.parallel_searches + stats.sequential_matches + stats.parallel_matches, 0u);
+}
+
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestAddDocuments);
@@ -123,4 +1368,28 @@ void TestSearchServer() {
     RUN_TEST(TestRelevanceDocuments);
     RUN_TEST(TestStatusFilter);
     RUN_TEST(TestFunctionPredicateFilter);
+    RUN_TEST(TestRemoveDocuments);
+    RUN_TEST(TestDocumentTextNotRequired);
+    RUN_TEST(TestTopDocumentsCount);
+    RUN_TEST(TestWandRetrieval);
+    RUN_TEST(TestParallelMatchesSequential);
+    RUN_TEST(TestMinusWordsSkipScoring);
+    RUN_TEST(TestAddDocumentsBatch);
+    RUN_TEST(TestSnapshotRoundTrip);
+    RUN_TEST(TestCorpusReader);
+    RUN_TEST(TestTombstoneCompaction);
+    RUN_TEST(TestConcurrentReadsDuringWrites);
+    RUN_TEST(TestIndexSegments);
+    RUN_TEST(TestCachedInverseDocumentFreq);
+    RUN_TEST(TestCompressedPostings);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestStopWordSet);
+    RUN_TEST(TestQueryResultCache);
+    RUN_TEST(TestQueryBatch);
+    RUN_TEST(TestProcessQueriesJoined);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestForwardIndex);
+    RUN_TEST(TestMatchDocumentsBatch);
+    RUN_TEST(TestPreparedQuery);
+    RUN_TEST(TestAdaptiveExecution);
 }
@@ -1,8 +1,20 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <sstream>
 #include <utility>
 #include <string>
+#include <thread>
 #include "search_server.h"
+#include "corpus_reader.h"
+#include "concurrent_search_server.h"
+#include "request_queue.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "snapshot.h"
 
 void TestExcludeStopWordsFromAddedDocumentContent();
 
@@ -22,6 +34,54 @@ void TestFunctionPredicateFilter();
 
 void TestStatusFilter();
 
+void TestRemoveDocuments();
+
+void TestDocumentTextNotRequired();
+
+void TestTopDocumentsCount();
+
+void TestWandRetrieval();
+
+void TestParallelMatchesSequential();
+
+void TestMinusWordsSkipScoring();
+
+void TestAddDocumentsBatch();
+
+void TestSnapshotRoundTrip();
+
+void TestCorpusReader();
+
+void TestTombstoneCompaction();
+
+void TestConcurrentReadsDuringWrites();
+
+void TestIndexSegments();
+
+void TestCachedInverseDocumentFreq();
+
+void TestCompressedPostings();
+
+void TestSplitIntoWords();
+
+void TestStopWordSet();
+
+void TestQueryResultCache();
+
+void TestQueryBatch();
+
+void TestProcessQueriesJoined();
+
+void TestRemoveDuplicates();
+
+void TestForwardIndex();
+
+void TestMatchDocumentsBatch();
+
+void TestPreparedQuery();
+
+void TestAdaptiveExecution();
+
 void TestSearchServer();
 
 template <typename T>
@@ -0,0 +1,200 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Tasks per worker in a job, so that workers finishing early have something to steal
+const size_t TASKS_PER_THREAD = 4;
+
+const size_t NO_WORKER = static_cast<size_t>(-1);
+
+// Lets a ParallelFor called from a worker push its tasks to that worker's own queue
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = NO_WORKER;
+
+size_t ResolveThreadCount(size_t thread_count) {
+    return thread_count != 0 ? thread_count : max<size_t>(1, thread::hardware_concurrency());
+}
+
+void PinThread(thread& worker, size_t worker_index) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(worker_index % max<size_t>(1, thread::hardware_concurrency()), &cpus);
+    // A failure only leaves the thread unpinned
+    pthread_setaffinity_np(worker.native_handle(), sizeof(cpus), &cpus);
+#else
+    (void)worker;
+    (void)worker_index;
+#endif
+}
+
+}
+
+ThreadPool::ThreadPool(size_t thread_count, bool pin_threads)
+    : thread_count_(ResolveThreadCount(thread_count))
+    , pin_threads_(pin_threads) {
+}
+
+ThreadPool::~ThreadPool() {
+    Stop();
+}
+
+void ThreadPool::Configure(size_t thread_count, bool pin_threads) {
+    lock_guard guard(start_mutex_);
+    Stop();
+    thread_count_ = ResolveThreadCount(thread_count);
+    pin_threads_ = pin_threads;
+}
+
+size_t ThreadPool::GetThreadCount() const {
+    return thread_count_;
+}
+
+void ThreadPool::Start() {
+    queues_.clear();
+    for (size_t i = 0; i < thread_count_; ++i) {
+        queues_.push_back(make_unique<WorkerQueue>());
+    }
+    is_stopping_ = false;
+    for (size_t i = 0; i < thread_count_; ++i) {
+        workers_.emplace_back([this, i] { WorkerLoop(i); });
+        if (pin_threads_) {
+            PinThread(workers_.back(), i);
+        }
+    }
+    is_started_.store(true, memory_order_release);
+}
+
+void ThreadPool::Stop() {
+    {
+        lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_up_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    queues_.clear();
+    is_started_.store(false, memory_order_release);
+}
+
+void ThreadPool::WorkerLoop(size_t worker_index) {
+    current_pool = this;
+    current_worker = worker_index;
+    Task task;
+    while (true) {
+        if (TakeTask(worker_index, task)) {
+            Execute(task);
+            continue;
+        }
+        unique_lock lock(sleep_mutex_);
+        wake_up_.wait(lock, [this] { return is_stopping_ || queued_task_count_ > 0; });
+        // Stop only runs when no job does, so nothing is left behind
+        if (is_stopping_) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::Run(Job& job, size_t count) {
+    if (!is_started_.load(memory_order_acquire)) {
+        lock_guard guard(start_mutex_);
+        if (!is_started_.load(memory_order_relaxed)) {
+            Start();
+        }
+    }
+
+    const size_t worker_index = current_pool == this ? current_worker : NO_WORKER;
+    const size_t task_count = min(count, thread_count_ * TASKS_PER_THREAD);
+    job.pending_task_count = task_count;
+    for (size_t i = 0; i < task_count; ++i) {
+        WorkerQueue& queue = *queues_[worker_index != NO_WORKER ? worker_index : i % thread_count_];
+        lock_guard guard(queue.tasks_mutex);
+        queue.tasks.push_back({ &job, count * i / task_count, count * (i + 1) / task_count });
+        ++queued_task_count_;
+    }
+    {
+        lock_guard guard(sleep_mutex_);
+    }
+    wake_up_.notify_all();
+
+    // Helps with the tasks until none is left, then waits for the ones still running
+    Task task;
+    while (true) {
+        {
+            lock_guard guard(job.done_mutex);
+            if (job.pending_task_count == 0) {
+                break;
+            }
+        }
+        if (TakeTask(worker_index, task)) {
+            Execute(task);
+            continue;
+        }
+        unique_lock lock(job.done_mutex);
+        job.done.wait(lock, [&job] { return job.pending_task_count == 0; });
+        break;
+    }
+    if (job.error) {
+        rethrow_exception(job.error);
+    }
+}
+
+bool ThreadPool::TakeTask(size_t worker_index, Task& task) {
+    if (queued_task_count_ == 0) {
+        return false;
+    }
+    if (worker_index != NO_WORKER) {
+        WorkerQueue& queue = *queues_[worker_index];
+        lock_guard guard(queue.tasks_mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+            --queued_task_count_;
+            return true;
+        }
+    }
+    const size_t first = worker_index != NO_WORKER ? worker_index + 1 : 0;
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        const size_t victim = (first + i) % queues_.size();
+        if (victim == worker_index) {
+            continue;
+        }
+        WorkerQueue& queue = *queues_[victim];
+        lock_guard guard(queue.tasks_mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            --queued_task_count_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Execute(const Task& task) {
+    Job& job = *task.job;
+    try {
+        job.invoke(job.function, task.begin, task.end);
+    }
+    catch (...) {
+        lock_guard guard(job.done_mutex);
+        if (!job.error) {
+            job.error = current_exception();
+        }
+    }
+    // The owner of the job may return as soon as the count drops to zero, so the job
+    // is not touched after the lock is released
+    lock_guard guard(job.done_mutex);
+    if (--job.pending_task_count == 0) {
+        job.done.notify_all();
+    }
+}
\ No newline at end of file
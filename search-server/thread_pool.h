@@ -0,0 +1,105 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Persistent worker threads for batches of queries. Every worker has its own task
+// queue: it takes its newest task first and, once the queue runs dry, steals the oldest
+// ones of the others. Workers start on the first ParallelFor and then sleep between jobs.
+class ThreadPool {
+public:
+    // thread_count 0 means one worker per hardware thread. With pin_threads, worker i
+    // runs on hardware thread i only, where the platform allows it
+    explicit ThreadPool(size_t thread_count = 0, bool pin_threads = false);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Stops the workers; the next ParallelFor starts the new ones. Must not run while
+    // a ParallelFor does
+    void Configure(size_t thread_count, bool pin_threads = false);
+
+    size_t GetThreadCount() const;
+
+    // Calls function(i) for every i in [0, count) and returns once all calls are done.
+    // The calling thread takes tasks as well, so a call from inside a worker is fine.
+    // Throws the first exception thrown by function, after the other calls are done
+    template <typename Function>
+    void ParallelFor(size_t count, const Function& function);
+
+private:
+    struct Job {
+        const void* function;
+        void (*invoke)(const void* function, size_t begin, size_t end);
+        mutex done_mutex;
+        condition_variable done;
+        size_t pending_task_count = 0;
+        exception_ptr error;
+    };
+
+    struct Task {
+        Job* job;
+        size_t begin;
+        size_t end;
+    };
+
+    struct WorkerQueue {
+        mutex tasks_mutex;
+        deque<Task> tasks;
+    };
+
+    size_t thread_count_;
+    bool pin_threads_;
+
+    mutex start_mutex_;
+    atomic<bool> is_started_{ false };
+
+    vector<thread> workers_;
+    vector<unique_ptr<WorkerQueue>> queues_;
+
+    // Workers sleep here while no queue holds a task
+    mutex sleep_mutex_;
+    condition_variable wake_up_;
+    atomic<size_t> queued_task_count_{ 0 };
+    bool is_stopping_ = false;
+
+    void Start();
+
+    void Stop();
+
+    void WorkerLoop(size_t worker_index);
+
+    void Run(Job& job, size_t count);
+
+    // Own queue first, from its back; then the fronts of the others
+    bool TakeTask(size_t worker_index, Task& task);
+
+    void Execute(const Task& task);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, const Function& function) {
+    if (count == 0) {
+        return;
+    }
+    Job job;
+    job.function = &function;
+    job.invoke = [](const void* erased, size_t begin, size_t end) {
+        const Function& function = *static_cast<const Function*>(erased);
+        for (size_t i = begin; i < end; ++i) {
+            function(i);
+        }
+    };
+    Run(job, count);
+}
\ No newline at end of file
@@ -0,0 +1,68 @@
+// Loads a corpus file into a SearchServer and reports the loading speed.
+// Build from the search-server directory:
+//   g++ -std=c++17 -O2 tools/corpus_loader.cpp $(ls *.cpp | grep -v main.cpp) -ltbb -pthread -o corpus_loader
+// Usage:
+//   corpus_loader <corpus file or -> [--seq] [--batch N] [--stop-words "words"] [--snapshot path]
+
+#include "../corpus_reader.h"
+#include "../search_server.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <execution>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: "s << argv[0] << " <corpus file or -> [--seq] [--batch N] [--stop-words \"words\"] [--snapshot path]"s << endl;
+        return 1;
+    }
+    const string path = argv[1];
+    bool is_sequential = false;
+    size_t batch_size = CORPUS_BATCH_SIZE;
+    string stop_words;
+    string snapshot_path;
+    for (int i = 2; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--seq"s) {
+            is_sequential = true;
+        }
+        else if (arg == "--batch"s && i + 1 < argc) {
+            batch_size = max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--stop-words"s && i + 1 < argc) {
+            stop_words = argv[++i];
+        }
+        else if (arg == "--snapshot"s && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        }
+        else {
+            cerr << "Unknown argument: "s << arg << endl;
+            return 1;
+        }
+    }
+
+    try {
+        SearchServer search_server(stop_words);
+        CorpusReader reader(path);
+        const auto start_time = chrono::steady_clock::now();
+        const size_t document_count = is_sequential
+            ? LoadCorpus(execution::seq, search_server, reader, batch_size)
+            : LoadCorpus(execution::par, search_server, reader, batch_size);
+        const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+        cout << "Loaded "s << document_count << " documents in "s << seconds << " s, "s
+            << (seconds > 0 ? document_count / seconds : 0.0) << " docs/sec"s << endl;
+        if (!snapshot_path.empty()) {
+            search_server.SaveSnapshot(snapshot_path);
+            cout << "Snapshot saved to "s << snapshot_path << endl;
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Error: "s << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
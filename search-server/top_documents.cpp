@@ -0,0 +1,58 @@
+#include "top_documents.h"
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t max_count)
+    : max_count_(max_count) {
+    // Any K is allowed, so only the usual result count is reserved up front;
+    // a larger heap grows with the documents actually added
+    heap_.reserve(min(max_count_, static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT)));
+}
+
+void TopDocuments::Add(const Document& document) {
+    // The heap front is the least relevant document kept
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+    else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+        pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() >= max_count_;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+vector<Document> TopDocuments::Extract() {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return move(heap_);
+}
+
+size_t TopDocuments::ExtractTo(Document* output) {
+    sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    move(heap_.begin(), heap_.end(), output);
+    const size_t count = heap_.size();
+    heap_.clear();
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "document.h"
+
+using namespace std;
+
+const int MAX_RESULT_DOCUMENT_COUNT = 5;
+
+const double EPSILON = 1e-6;
+
+// Relevance first, rating for relevances closer than EPSILON, id as the last resort
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Keeps the best max_count documents seen so far in a bounded heap,
+// so selecting the top never needs to sort every matched document.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count);
+
+    void Add(const Document& document);
+
+    void Merge(const TopDocuments& other);
+
+    bool IsFull() const;
+
+    // The document that would be evicted next; valid only when the collector is not empty
+    const Document& GetWorst() const;
+
+    // Most relevant first
+    vector<Document> Extract();
+
+    // Moves the documents, most relevant first, to output; returns how many there were
+    size_t ExtractTo(Document* output);
+
+private:
+    size_t max_count_;
+
+    vector<Document> heap_;
+};
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "word_frequencies.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+WordFrequencies::Iterator::Iterator(const WordFrequencies& frequencies, size_t position)
+    : dictionary_(frequencies.dictionary_)
+    , term_ids_(frequencies.term_ids_)
+    , term_freqs_(frequencies.term_freqs_)
+    , size_(frequencies.size_)
+    , position_(position) {
+    Load();
+}
+
+WordFrequencies::Iterator::reference WordFrequencies::Iterator::operator*() const {
+    return value_;
+}
+
+WordFrequencies::Iterator::pointer WordFrequencies::Iterator::operator->() const {
+    return &value_;
+}
+
+WordFrequencies::Iterator& WordFrequencies::Iterator::operator++() {
+    ++position_;
+    Load();
+    return *this;
+}
+
+WordFrequencies::Iterator WordFrequencies::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool WordFrequencies::Iterator::operator==(const Iterator& other) const {
+    return position_ == other.position_;
+}
+
+bool WordFrequencies::Iterator::operator!=(const Iterator& other) const {
+    return !(*this == other);
+}
+
+void WordFrequencies::Iterator::Load() {
+    if (position_ < size_) {
+        value_ = { dictionary_->GetTerm(term_ids_[position_]), term_freqs_[position_] };
+    }
+}
+
+WordFrequencies::WordFrequencies(const TermDictionary& dictionary, const int* term_ids, const double* term_freqs, size_t size)
+    : dictionary_(&dictionary)
+    , term_ids_(term_ids)
+    , term_freqs_(term_freqs)
+    , size_(size) {
+}
+
+WordFrequencies::Iterator WordFrequencies::begin() const {
+    return Iterator(*this, 0);
+}
+
+WordFrequencies::Iterator WordFrequencies::end() const {
+    return Iterator(*this, size_);
+}
+
+size_t WordFrequencies::size() const {
+    return size_;
+}
+
+bool WordFrequencies::empty() const {
+    return size_ == 0;
+}
+
+size_t WordFrequencies::count(const string_view& word) const {
+    return Find(word) < size_ ? 1 : 0;
+}
+
+double WordFrequencies::at(const string_view& word) const {
+    const size_t position = Find(word);
+    if (position == size_) {
+        throw out_of_range("Document has no word "s + string(word));
+    }
+    return term_freqs_[position];
+}
+
+bool WordFrequencies::operator==(const WordFrequencies& other) const {
+    if (size_ != other.size_) {
+        return false;
+    }
+    // Views over one dictionary share the ids, so the arrays compare directly
+    if (dictionary_ == other.dictionary_) {
+        return equal(term_ids_, term_ids_ + size_, other.term_ids_) && equal(term_freqs_, term_freqs_ + size_, other.term_freqs_);
+    }
+    for (size_t i = 0; i < size_; ++i) {
+        const size_t position = other.Find(dictionary_->GetTerm(term_ids_[i]));
+        if (position == other.size_ || other.term_freqs_[position] != term_freqs_[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WordFrequencies::operator!=(const WordFrequencies& other) const {
+    return !(*this == other);
+}
+
+size_t WordFrequencies::Find(const string_view& word) const {
+    if (size_ == 0) {
+        return size_;
+    }
+    const int term_id = dictionary_->Find(word);
+    if (term_id == TermDictionary::NO_TERM) {
+        return size_;
+    }
+    const int* it = lower_bound(term_ids_, term_ids_ + size_, term_id);
+    return it != term_ids_ + size_ && *it == term_id ? static_cast<size_t>(it - term_ids_) : size_;
+}
\ No newline at end of file
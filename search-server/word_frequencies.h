@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+#include "term_dictionary.h"
+
+using namespace std;
+
+// Read-only view of the term frequencies of one document: two parallel arrays of term
+// ids, ascending, and their frequencies, with the words looked up in the dictionary.
+// Works like a map from word to frequency, but iterates in term id order. Valid until
+// the server it came from is changed
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = forward_iterator_tag;
+        using value_type = pair<string_view, double>;
+        using difference_type = ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator() = default;
+
+        // Keeps the pointers of the view, not the view itself, so that it stays
+        // valid as long as the data does, even when the view was a temporary
+        Iterator(const WordFrequencies& frequencies, size_t position);
+
+        reference operator*() const;
+
+        pointer operator->() const;
+
+        Iterator& operator++();
+
+        Iterator operator++(int);
+
+        bool operator==(const Iterator& other) const;
+
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        const TermDictionary* dictionary_ = nullptr;
+        const int* term_ids_ = nullptr;
+        const double* term_freqs_ = nullptr;
+        size_t size_ = 0;
+        size_t position_ = 0;
+        value_type value_;
+
+        void Load();
+    };
+
+    WordFrequencies() = default;
+
+    WordFrequencies(const TermDictionary& dictionary, const int* term_ids, const double* term_freqs, size_t size);
+
+    Iterator begin() const;
+
+    Iterator end() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    size_t count(const string_view& word) const;
+
+    // Throws out_of_range if the document does not hold the word
+    double at(const string_view& word) const;
+
+    // Equal when both hold the same words with the same frequencies, whichever ids they have
+    bool operator==(const WordFrequencies& other) const;
+
+    bool operator!=(const WordFrequencies& other) const;
+
+private:
+    const TermDictionary* dictionary_ = nullptr;
+    const int* term_ids_ = nullptr;
+    const double* term_freqs_ = nullptr;
+    size_t size_ = 0;
+
+    // Position of the word in the arrays, or size_ if it is not there
+    size_t Find(const string_view& word) const;
+};
\ No newline at end of file